@@ -3,11 +3,22 @@
 //October 11, 2023
 
 #include <iostream>         // cout, cerr
-#include <cstdlib>          // EXIT_FAILURE
+#include <cstdlib>          // EXIT_FAILURE, strtol
+#include <cerrno>           // errno
+#include <string>           // to_string
+#include <chrono>           // steady_clock
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #include <vector>
+#include <algorithm>
 #include "meshes.h"
+#include "uniforms.h"
+#include "scene.h"
+#include "textures.h"
+#include "imageops.h"
+#include "shadermanager.h"
+#include "permutations.h"
+#include "simulation.h"
 
 
 // GLM Math Header inclusions
@@ -21,11 +32,6 @@
 
 using namespace std; // Standard namespace
 
-/*Shader program Macro*/
-#ifndef GLSL
-#define GLSL(Version, Source) "#version " #Version " core \n" #Source
-#endif
-
 // Unnamed namespace
 namespace
 {
@@ -35,27 +41,25 @@ namespace
     const int WINDOW_WIDTH = 1200;
     const int WINDOW_HEIGHT = 900;
 
-    //camera initial settings
+    //camera initial settings; the simulation thread owns the camera once it starts
     // camera
-    glm::vec3 cameraPos = glm::vec3(2.5f, 3.0f, 12.0f);
-    glm::vec3 cameraFront = glm::vec3(0.0f, -0.5f, -1.0f);
-    glm::vec3 cameraRight = glm::vec3(1.0f, 0.0f, 0.0f);
-    glm::vec3 cameraUp = glm::normalize(glm::cross(cameraPos, cameraRight));
+    const glm::vec3 INITIAL_CAMERA_POSITION = glm::vec3(2.5f, 3.0f, 12.0f);
+    const glm::vec3 INITIAL_CAMERA_FRONT = glm::vec3(0.0f, -0.5f, -1.0f);
+    const glm::vec3 INITIAL_CAMERA_RIGHT = glm::vec3(1.0f, 0.0f, 0.0f);
+    const float INITIAL_CAMERA_YAW = -90.0f;	// yaw is initialized to -90.0 degrees since a yaw of 0.0 results in a direction vector pointing to the right so we initially rotate a bit to the left.
 
+    // Cursor tracking for the mouse callback; what the input does to the camera is up to the simulation
     bool firstMouse = true;
-    bool orthoOn = false;
-    glm::mat4 projection; //move to a global to set from a keystroke
-
-    float yaw = -90.0f;	// yaw is initialized to -90.0 degrees since a yaw of 0.0 results in a direction vector pointing to the right so we initially rotate a bit to the left.
-    float pitch = 0.0f;
     float lastX = WINDOW_WIDTH / 2.0;
     float lastY = WINDOW_HEIGHT / 2.0;
     float fov = 45.0f;
-    float sensitivity = 0.03f; // change this to a global with a default; to be controlled by scroll
 
-    // timing
-    float deltaTime = 0.0f;	// time between current frame and last frame
-    float lastFrame = 0.0f;
+    // Events the simulation's queue had no room for, reported from UProcessInput rather than the callbacks
+    GLuint gDroppedInputEvents = 0;
+    GLuint gReportedInputEvents = 0;
+
+    // Camera and scene updates run on their own thread at a fixed tick
+    Simulation gSimulation;
 
     // Key light
     glm::vec3 gKeyColor(1.0f, 0.95f, 0.8f);
@@ -69,12 +73,137 @@ namespace
     //Generic primative shape mesh
     Meshes meshes;
 
-    // Shader programs
-    GLuint gProgramId;
+    // Objects to draw, loaded from a scene file (see Scenes/desk.scene)
+    const char* gScenePath = "Scenes/desk.scene";
+    Scene gScene;
+
+    // Scene objects sorted by shader variant and mesh, with the bounds used to
+    // pick each one's level of detail every frame
+    struct DrawObject
+    {
+        MeshInstance instance;  // instance.material selects the texture
+        GLuint program;         // index into gCubePrograms
+        bool textured;          // its variant samples instance.material
+        GLuint textureArray;    // gTextureLoader array holding the material, 0 if not textured
+        MeshType mesh;
+        glm::vec3 center;       // world space bounding sphere
+        float radius;
+        float scale;            // largest axis scale of the model matrix
+        GLuint lod;             // level chosen for the current buffers
+    };
+    std::vector<DrawObject> gDrawObjects;
+
+    // Objects become one indirect draw command per (variant, texture array, mesh,
+    // level); only the texture array is bound between draws, so each shader
+    // variant is one multi-draw call per array it samples, and a single one with
+    // bindless textures. A bindless handle must be dynamically uniform within a
+    // draw, so on that path textured commands are also split per material.
+    GLuint gInstanceVbo = 0;    // MeshInstance per scene object, sorted by draw command
+    GLuint gIndirectBuffer = 0; // DrawElementsIndirectCommand per (variant, array, mesh, level)
+
+    // A run of gIndirectBuffer drawn with one multi-draw, rebuilt by UUpdateDrawCommands
+    struct DrawRun
+    {
+        GLuint program;         // index into gCubePrograms
+        GLuint textureArray;
+        GLuint firstCommand;
+        GLuint commandCount;
+    };
+    std::vector<DrawRun> gDrawRuns;
+
+    // Largest on-screen surface error, in pixels, a coarser level may introduce
+    const float LOD_PIXEL_ERROR = 1.0f;
+
+    // Shader programs: handles from gShaders, and the programs they link to
+    ShaderManager gShaders;
+    GLuint gLampShader;
     GLuint gLampId;
 
-    // Texture id
-    GLuint gTextureWatchFace, gTextureLeather, gTextureWood, gTextureCubeFace, gTextureCopper, gTextureGlass;
+    // Variants of the scene shader (see permutations.h), one per material
+    // permutation the scene uses, sorted by key: opaque ones draw first
+    ShaderPermutations gPermutations;
+    struct CubeProgram
+    {
+        PermutationKey key;
+        GLuint shader;          // handle from gShaders
+        GLuint program;
+        Uniform<glm::vec2> uvScale;     // resolved once after linking (see UResolveUniforms)
+        Uniform<GLint> texture;
+    };
+    std::vector<CubeProgram> gCubePrograms;
+
+    // Uniform handles resolved once after linking (see UResolveUniforms)
+    struct LampUniforms
+    {
+        Uniform<glm::mat4> model;
+    } gLampUniforms;
+
+    // Per-frame camera and light state shared by every program.
+    // std140 layout: must match the FrameData block in the shaders.
+    const GLuint FRAME_UBO_BINDING = 0;
+    struct FrameData
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec4 viewPosition;     // xyz: camera position
+        glm::vec4 lightColor;       // rgb: key light color
+        glm::vec4 lightPos;         // xyz: key light position
+        float time;                 // seconds since glfwInit
+        float padding[3];
+        glm::vec4 pointLightPositions[MAX_POINT_LIGHTS];    // xyz: the scene's lights, in order
+        glm::vec4 pointLightColors[MAX_POINT_LIGHTS];       // rgb
+    };
+
+    // The frame uniforms are a ring of copies in one persistently mapped buffer.
+    // Each frame writes its own slot and fences it, so the CPU never waits on
+    // an upload and never overwrites a copy the GPU may still be reading.
+    const GLuint FRAME_UBO_SLOTS = 3;
+    GLuint gFrameUbo = 0;
+    GLsizeiptr gFrameSlotSize = 0;          // sizeof(FrameData) rounded up to the binding offset alignment
+    unsigned char* gFrameMapping = nullptr;
+    GLsync gFrameFences[FRAME_UBO_SLOTS] = {};
+    GLuint gFrameSlot = 0;
+
+    // --late-latch samples the camera again once the frame's CPU work is done,
+    // right before its first draw is issued, with the mouse look queued since
+    // the newest simulation tick applied directly, and writes it over the
+    // camera in this frame's slot
+    bool gLateLatch = false;
+
+    // --latency reports how long the input behind each frame's camera waited
+    // until SwapBuffers returned for that frame
+    bool gMeasureLatency = false;
+    double gLatencyInputTime = 0.0;     // last input stamp measured, so idle frames are not counted
+    double gLatencyTotal = 0.0;
+    double gLatencyMax = 0.0;
+    GLuint gLatencySamples = 0;
+
+    // GPU timing of the scene pass, enabled with --bench on the command line.
+    // Two queries alternate so reading last frame's result never stalls.
+    bool gBenchmark = false;
+    GLuint gTimerQueries[2];
+    GLuint gTimerFrame = 0;
+    GLuint64 gGpuTimeTotal = 0;
+    GLuint gGpuTimeSamples = 0;
+
+    // --bench-mips times CPU mip generation against glGenerateMipmap for every
+    // scene texture, then exits
+    bool gBenchmarkMips = false;
+
+    // Material index of each texture, indexed like gScene.texturePaths
+    std::vector<GLuint> gMaterials;
+    TextureLoader gTextureLoader;   // decodes on worker threads, uploads in the render loop
+
+    // Bindless handles replace the texture array when GL_ARB_bindless_texture is
+    // available, unless --no-bindless is given. --texture-budget <MB> limits how
+    // much texture memory the resident handles may use.
+    bool gBindlessAllowed = true;
+    bool gBindless = false;
+    GLuint64 gTextureBudget = DEFAULT_RESIDENCY_BUDGET;
+
+    // --hot-reload watches the shader files and swaps in every program edited
+    // while the scene runs, keeping the old one if the edit does not link
+    bool gHotReload = false;
 }
 
 /* User-defined Function prototypes to:
@@ -86,216 +215,210 @@ bool UInitialize(int, char* [], GLFWwindow** window);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
-
-//textures
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
+void UResolveUniforms();
+void UUseLinkedPrograms();
+
+// scene shader variants
+void URequestCubePrograms();
+GLuint UCubeProgramIndex(GLuint object);
+
+// per-frame uniform buffer
+bool UCreateFrameUniforms();
+FrameData* UFrameSlot();
+void UBeginFrameUniforms();
+void UUpdateFrameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition);
+void ULatchFrameCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition);
+void UEndFrameUniforms();
+void UDestroyFrameUniforms();
+
+// camera matrices and input latency
+void UCameraMatrices(const CameraState& camera, glm::mat4& view, glm::mat4& projection);
+void UMeasureLatency(double inputTime, double swapTime);
+
+// per-object transforms
+glm::mat3 UNormalMatrix(const glm::mat4& model);
+
+// instanced scene batches
+void UBuildInstanceBatches();
+void UUpdateDrawCommands(const glm::mat4& view, const glm::mat4& projection);
+void UDestroyInstanceBatches();
+
+// GPU timer used by --bench
+void UBeginGpuTimer();
+void UEndGpuTimer();
+void UBenchmarkMipmaps();
+void UPrintTextureStats();
 
 //add the new prototypes for the keys and mouse controls
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void UPushInputEvent(InputEventType type, const glm::vec2& value = glm::vec2(0.0f), GLuint button = 0);
 
-/* Cube Vertex Shader Source Code*/
-const GLchar*  cubeVertexShaderSource = GLSL(440,
-
-    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
-layout(location = 1) in vec3 normal; // VAP position 1 for normals
-layout(location = 2) in vec2 textureCoordinate;
-
-out vec3 vertexNormal; // For outgoing normals to fragment shader
-out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
-out vec2 vertexTextureCoordinate;
-
-//Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
-
-    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
-
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
-    vertexTextureCoordinate = textureCoordinate;
-}
-);
-
-/* Cube Fragment Shader Source Code*/
-const GLchar* cubeFragmentShaderSource = GLSL(440,
-
-    in vec3 vertexNormal; // For incoming normals
-in vec3 vertexFragmentPos; // For incoming fragment position
-in vec2 vertexTextureCoordinate;
-
-out vec4 fragmentColor; // For outgoing cube color to the GPU
-
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec3 objectColor;
-uniform vec3 lightColor;
-uniform vec3 lightPos;
-uniform vec3 keyColor;
-uniform vec3 keyPos;
-uniform vec3 viewPosition;
-uniform sampler2D uTexture; // Useful when working with multiple textures
-uniform vec2 uvScale;
-
-void main()
-{
-    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
-
-    //Calculate Ambient lighting*/
-    float ambientStrength = 0.1f; // Set ambient or global lighting strength
-    vec3 ambient = ambientStrength * lightColor; // Generate ambient light color
-
-    float keyStrength = 1.0f;
-    vec3 key = keyStrength * keyColor;
-
-    //Calculate Diffuse lighting*/
-    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 lightDirection = normalize(lightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 diffuse = impact * lightColor; // Generate diffuse light color
-
-    //Calculate Specular lighting*/
-    float specularIntensity = 2.0f; // Set specular light strength
-    float highlightSize = 10.0f; // Set specular highlight size
-    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-    //Calculate specular component
-    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    vec3 specular = specularIntensity * specularComponent * lightColor;
-
-    // Texture holds the color to be used for all three components
-    vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
-
-    // Calculate phong result
-    vec3 phong = (ambient + key + diffuse + specular) * textureColor.xyz;
-
-    fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
-}
-);
-
-/* Lamp Shader Source Code*/
-const GLchar* lampVertexShaderSource = GLSL(440,
-
-    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
-
-//Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
-}
-);
-
-/* Fragment Shader Source Code*/
-const GLchar* lampFragmentShaderSource = GLSL(440,
-
-    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
+/* The cube program lives in Shaders/cube.vert and Shaders/cube.frag, which
+ * include the FrameData block and the material sampling for either texture path.
+ */
+const char* const CUBE_VERTEX_SHADER_PATH = "Shaders/cube.vert";
+const char* const CUBE_FRAGMENT_SHADER_PATH = "Shaders/cube.frag";
 
-void main()
-{
-    fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
-}
-);
+/* The lamp program lives in Shaders/lamp.vert and Shaders/lamp.frag and shares
+ * the FrameData block with the cube program.
+ */
+const char* const LAMP_VERTEX_SHADER_PATH = "Shaders/lamp.vert";
+const char* const LAMP_FRAGMENT_SHADER_PATH = "Shaders/lamp.frag";
 
 int main(int argc, char* argv[])
 {
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--bench")
+            gBenchmark = true;
+        else if (string(argv[i]) == "--bench-mips")
+            gBenchmarkMips = true;
+        else if (string(argv[i]) == "--scene" && i + 1 < argc)
+            gScenePath = argv[++i];
+        else if (string(argv[i]) == "--no-bindless")
+            gBindlessAllowed = false;
+        else if (string(argv[i]) == "--hot-reload")
+            gHotReload = true;
+        else if (string(argv[i]) == "--late-latch")
+            gLateLatch = true;
+        else if (string(argv[i]) == "--latency")
+            gMeasureLatency = true;
+        else if (string(argv[i]) == "--texture-budget" && i + 1 < argc)
+        {
+            // Whole megabytes; a typo must not quietly become no budget or an unlimited one
+            const char* value = argv[++i];
+            char* end = nullptr;
+            errno = 0;
+            const long megabytes = strtol(value, &end, 10);
+            if (end == value || *end != '\0' || errno == ERANGE || megabytes <= 0)
+            {
+                cout << "ERROR: bad --texture-budget '" << value << "'" << endl;
+                cout << "usage: --texture-budget <megabytes>, a whole number greater than 0" << endl;
+                return EXIT_FAILURE;
+            }
+            gTextureBudget = GLuint64(megabytes) * 1024 * 1024;
+        }
+    }
+
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
-    // Create the shader program
-    if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gProgramId))
+    gBindless = gBindlessAllowed && GLEW_ARB_bindless_texture;
+    cout << "Textures: " << (gBindless ? "bindless handles" : "texture array") << endl;
+
+    // Submit the programs as early as possible; the driver compiles them while the scene loads
+    const std::chrono::steady_clock::time_point shadersSubmitted = std::chrono::steady_clock::now();
+    gShaders.Start();
+    if (gHotReload)
+        gShaders.WatchFiles();
+
+    // Every program that includes Shaders/frame.glsl needs its binding and array size
+    const std::vector<std::string> frameDefines = {
+        "FRAME_UBO_BINDING " + std::to_string(FRAME_UBO_BINDING),
+        "MAX_POINT_LIGHTS " + std::to_string(MAX_POINT_LIGHTS),
+    };
+
+    // Every scene shader variant starts from this; URequestCubePrograms adds the material features
+    ProgramDesc cubeDesc;
+    cubeDesc.vertex = ShaderSource::File(CUBE_VERTEX_SHADER_PATH);
+    cubeDesc.fragment = ShaderSource::File(CUBE_FRAGMENT_SHADER_PATH);
+    cubeDesc.defines = frameDefines;
+    cubeDesc.defines.push_back("MATERIAL_SSBO_BINDING " + std::to_string(MATERIAL_SSBO_BINDING));
+    if (gBindless)
+        cubeDesc.defines.push_back("BINDLESS_TEXTURES");
+    gPermutations.Start(&gShaders, cubeDesc);
+
+    ProgramDesc lampDesc;
+    lampDesc.vertex = ShaderSource::File(LAMP_VERTEX_SHADER_PATH);
+    lampDesc.fragment = ShaderSource::File(LAMP_FRAGMENT_SHADER_PATH);
+    lampDesc.defines = frameDefines;
+    gLampShader = gShaders.Submit(lampDesc);
+
+    // Camera and light state is written once per frame into a shared buffer
+    if (!UCreateFrameUniforms())
         return EXIT_FAILURE;
 
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampId))
-        return EXIT_FAILURE;
+    if (gBenchmark)
+        glGenQueries(2, gTimerQueries);
     // Create the mesh
     //UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
     meshes.CreateMeshes();
 
-    // Load texture 0
-    const char* tex1 = "Textures/wood.jpg";
-    if (!UCreateTexture(tex1, gTextureWood))
+    // Load the scene description and every texture it references
+    if (!gScene.Load(gScenePath))
     {
-        cout << "Failed to load texture " << tex1 << endl;
+        cout << "Failed to load scene " << gScenePath << endl;
         return EXIT_FAILURE;
     }
 
-    // Load texture 1
-    const char* tex2 = "Textures/leather.jpg";
-    if (!UCreateTexture(tex2, gTextureLeather))
-    {
-        cout << "Failed to load texture " << tex2 << endl;
-        return EXIT_FAILURE;
-    }
+    // Only the variants the scene's materials need are built
+    URequestCubePrograms();
 
-    // Load texture 2
-    const char* tex3 = "Textures/faceWatch.png";
-    if (!UCreateTexture(tex3, gTextureWatchFace))
+    if (gBenchmarkMips)
     {
-        cout << "Failed to load texture " << tex3 << endl;
-        return EXIT_FAILURE;
+        UBenchmarkMipmaps();
+        meshes.DestroyMeshes();
+        UDestroyFrameUniforms();
+        gShaders.Destroy();
+        exit(EXIT_SUCCESS);
     }
 
-    // Load texture 3
-    const char* tex4 = "Textures/cubeface.png";
-    if (!UCreateTexture(tex4, gTextureCubeFace))
-    {
-        cout << "Failed to load texture " << tex4 << endl;
+    // Textures decode in the background; each material shows a placeholder until it is uploaded
+    gTextureLoader.SetResidencyBudget(gTextureBudget);
+    gTextureLoader.Start(GLuint(gScene.texturePaths.size()), gBindless);
+    gMaterials.resize(gScene.texturePaths.size());
+    for (size_t i = 0; i < gScene.texturePaths.size(); i++)
+        gMaterials[i] = gTextureLoader.Load(gScene.texturePaths[i].c_str());
+
+    // Group the scene into one instanced draw per shader variant and mesh
+    UBuildInstanceBatches();
+
+    // First use of the programs: wait only for what the driver has not finished yet
+    const std::chrono::steady_clock::time_point shadersNeeded = std::chrono::steady_clock::now();
+    bool shadersWereReady = gShaders.Ready(gLampShader);
+    for (const CubeProgram& cube : gCubePrograms)
+        shadersWereReady &= gShaders.Ready(cube.shader);
+    if (!gShaders.FinishAll())
         return EXIT_FAILURE;
-    }
+    const std::chrono::steady_clock::time_point shadersLinked = std::chrono::steady_clock::now();
+    cout << "INFO: " << gCubePrograms.size() << " scene shader variants, shaders " << (shadersWereReady ? "ready" : "linked") << " after "
+        << std::chrono::duration<double, std::milli>(shadersLinked - shadersSubmitted).count() << " ms, waited "
+        << std::chrono::duration<double, std::milli>(shadersLinked - shadersNeeded).count() << " ms" << endl;
 
-    // Load texture 3
-    const char* tex5 = "Textures/copper.jpg";
-    if (!UCreateTexture(tex5, gTextureCopper))
-    {
-        cout << "Failed to load texture " << tex5 << endl;
-        return EXIT_FAILURE;
-    }
-
-    // Load texture 3
-    const char* tex6 = "Textures/blue.jpg";
-    if (!UCreateTexture(tex6, gTextureGlass))
-    {
-        cout << "Failed to load texture " << tex6 << endl;
-        return EXIT_FAILURE;
-    }
-
-
-
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gProgramId);
-
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
+    UUseLinkedPrograms();
 
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    // From here on the camera moves at the simulation's fixed tick, whatever the frame rate
+    CameraState camera;
+    camera.position = INITIAL_CAMERA_POSITION;
+    camera.front = INITIAL_CAMERA_FRONT;
+    camera.up = glm::normalize(glm::cross(INITIAL_CAMERA_POSITION, INITIAL_CAMERA_RIGHT));
+    camera.yaw = INITIAL_CAMERA_YAW;
+    camera.pitch = 0.0f;
+    camera.ortho = false;
+    gSimulation.Start(camera);
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(gWindow))
     {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
+        // input: sampled here, applied by the simulation at its next tick
         // -----
         UProcessInput(gWindow);
 
+        // Upload any textures the workers finished decoding
+        if (gTextureLoader.Update() > 0 && gTextureLoader.Pending() == 0)
+            UPrintTextureStats();
+
+        // Swap in shaders edited on disk once they link; URender keeps the old ones until then
+        if (gShaders.Update() > 0)
+            UUseLinkedPrograms();
+
         // Render this frame
         // Turn on wireframe mode
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); //use wireframe for QA GL_FILL for off GL_LINE for on
@@ -304,20 +427,24 @@ int main(int argc, char* argv[])
         glfwPollEvents();
     }
 
+    gSimulation.Stop();
+
     //delete the meshes
+    UDestroyInstanceBatches();
     meshes.DestroyMeshes();
 
     // Release texture
-    UDestroyTexture(gTextureWood);
-    UDestroyTexture(gTextureWatchFace);
-    UDestroyTexture(gTextureLeather);
-    UDestroyTexture(gTextureCubeFace);
-    UDestroyTexture(gTextureCopper);
-    UDestroyTexture(gTextureGlass);
+    for (GLuint material : gMaterials)
+        gTextureLoader.Release(material);
+    gMaterials.clear();
+    gTextureLoader.DestroyTextures();
+
+    if (gBenchmark)
+        glDeleteQueries(2, gTimerQueries);
 
     // Release shader program
-    UDestroyShaderProgram(gProgramId);
-    UDestroyShaderProgram(gLampId);
+    UDestroyFrameUniforms();
+    gShaders.Destroy();
 
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
@@ -332,6 +459,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -373,76 +501,72 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     // Displays GPU OpenGL version
     cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
 
+    // Textures are sRGB, so shading happens in linear light and is encoded on write
+    glEnable(GL_FRAMEBUFFER_SRGB);
+
     return true;
 }
 
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// process all input: the callbacks queue camera input for the simulation, this handles what belongs to the window
 void UProcessInput(GLFWwindow* window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
-    //TODO
-    //WASD Keys to pan Left, Tight, forward, back
-    float cameraSpeed = static_cast<float>(25 * deltaTime * sensitivity);
-    glm::vec3 front;
-
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        cameraPos += cameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        cameraPos -= cameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
-        pitch += cameraSpeed * 5;
-        front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-        front.y = sin(glm::radians(pitch));
-        front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-        cameraFront = glm::normalize(front);
-    }
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
-        pitch -= cameraSpeed * 5;
-        front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-        front.y = sin(glm::radians(pitch));
-        front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-        cameraFront = glm::normalize(front);
+
+    if (gDroppedInputEvents != gReportedInputEvents)
+    {
+        cout << "WARNING: input queue full, " << gDroppedInputEvents - gReportedInputEvents << " events dropped" << endl;
+        gReportedInputEvents = gDroppedInputEvents;
     }
 }
 
+// Stamp an input event and queue it for the simulation's next tick; no I/O here, the callbacks run per event
+void UPushInputEvent(InputEventType type, const glm::vec2& value, GLuint button)
+{
+    InputEvent event;
+    event.time = gSimulation.Now();
+    event.value = value;
+    event.button = button;
+    event.type = type;
+    if (!gSimulation.PushEvent(event))
+        gDroppedInputEvents++;
+}
+
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    // Key repeat is ignored: the simulation moves the camera for as long as a key is down
+    if (action == GLFW_REPEAT)
+        return;
+
+    //WASD Keys to pan Left, Tight, forward, back; Q and E to pitch
+    GLuint button = 0;
+    switch (key)
     {
+    case GLFW_KEY_W: button = INPUT_FORWARD; break;
+    case GLFW_KEY_S: button = INPUT_BACK; break;
+    case GLFW_KEY_A: button = INPUT_LEFT; break;
+    case GLFW_KEY_D: button = INPUT_RIGHT; break;
+    case GLFW_KEY_Q: button = INPUT_PITCH_UP; break;
+    case GLFW_KEY_E: button = INPUT_PITCH_DOWN; break;
+
+    case GLFW_KEY_P:
         //toggle the orthographic view
-        //set the ortho view then flip the global variable
-        if (orthoOn) {
-            orthoOn = false;
-            cout << "Ortho State" << orthoOn << endl;
-        }
-        else {
-            orthoOn = true;
-            cout << "Ortho State" << orthoOn << endl;
-        }
+        if (action == GLFW_PRESS)
+            UPushInputEvent(INPUT_EVENT_TOGGLE_ORTHO);
+        return;
+
+    default:
+        return;
     }
+
+    UPushInputEvent(action == GLFW_PRESS ? INPUT_EVENT_BUTTON_DOWN : INPUT_EVENT_BUTTON_UP, glm::vec2(0.0f), button);
 }
 
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    //fov -= (float)yoffset;
-    //if (fov < 1.0f)
-    //    fov = 1.0f;
-    //if (fov > 90.0f)
-    //    fov = 90.0f;
-    sensitivity += 0.01 * (float)yoffset;;
-    // make sure that when pitch is out of bounds, screen doesn't get flipped
-    if (sensitivity > 3.0f)
-        sensitivity = 3.0f;
-    if (sensitivity < 0.01f)
-        sensitivity = 0.01f;
-
-    cout << sensitivity << endl;
+    // the wheel changes the sensitivity, clamped by the simulation
+    UPushInputEvent(INPUT_EVENT_SENSITIVITY, glm::vec2(0.0f, static_cast<float>(yoffset)));
 }
 
 void mouseCallback(GLFWwindow* window, double xposIn, double yposIn)
@@ -462,65 +586,17 @@ void mouseCallback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    xoffset *= sensitivity;
-    yoffset *= sensitivity;
-
-    yaw += xoffset;
-    pitch += yoffset;
-
-    // make sure that when pitch is out of bounds, screen doesn't get flipped
-    if (pitch > 89.0f)
-        pitch = 89.0f;
-    if (pitch < -89.0f)
-        pitch = -89.0f;
-
-    glm::vec3 front;
-    front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-    front.y = sin(glm::radians(pitch));
-    front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-    cameraFront = glm::normalize(front);
-
+    // The simulation scales by the sensitivity in effect when it applies the event
+    UPushInputEvent(INPUT_EVENT_LOOK, glm::vec2(xoffset, yoffset));
 }
 
 // glfw: handle mouse button events
 // --------------------------------
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
-    switch (button)
-    {
-    case GLFW_MOUSE_BUTTON_LEFT:
-    {
-        if (action == GLFW_PRESS)
-            cout << "Left mouse button pressed" << endl;
-        else
-            cout << "Left mouse button released" << endl;
-    }
-    break;
-
-    case GLFW_MOUSE_BUTTON_MIDDLE:
-    {
-        if (action == GLFW_PRESS) {
-            cout << "Middle mouse button pressed - sensitivity reset" << endl;
-            sensitivity = 0.03f;
-        }
-        else
-            cout << "Middle mouse button released" << endl;
-    }
-    break;
-
-    case GLFW_MOUSE_BUTTON_RIGHT:
-    {
-        if (action == GLFW_PRESS)
-            cout << "Right mouse button pressed" << endl;
-        else
-            cout << "Right mouse button released" << endl;
-    }
-    break;
-
-    default:
-        cout << "Unhandled mouse button event" << endl;
-        break;
-    }
+    // Only the middle button does anything: it resets the sensitivity
+    if (button == GLFW_MOUSE_BUTTON_MIDDLE && action == GLFW_PRESS)
+        UPushInputEvent(INPUT_EVENT_SENSITIVITY_RESET);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -533,11 +609,9 @@ void UResizeWindow(GLFWwindow* window, int width, int height)
 void URender()
 {
 
-    glm::mat4 scale;
-    glm::mat4 rotation;
-    glm::mat4 translation;
     glm::mat4 model;
     glm::mat4 view;
+    glm::mat4 projection;
 
     // Enable z-depth
     glEnable(GL_DEPTH_TEST);
@@ -546,339 +620,623 @@ void URender()
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Transforms the camera: move the camera back (z axis)
-    view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    // The camera for this instant, blended between the simulation's last two ticks
+    const CameraState camera = gSimulation.Sample(gSimulation.Now());
+    UCameraMatrices(camera, view, projection);
 
-    if (orthoOn) {
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); //use the orthographic projection for QA
+    // One write feeds the camera and light to every program
+    UBeginFrameUniforms();
+    UUpdateFrameUniforms(view, projection, camera.position);
+
+    // Pick each object's level of detail for this camera
+    UUpdateDrawCommands(view, projection);
+
+    // The material table, and on the bindless path every handle the frame uses
+    gTextureLoader.BindTextures();
+
+    // The frame's CPU work is done and nothing that reads the camera is issued
+    // yet: sample it again with the input that arrived meanwhile. Level of
+    // detail keeps the earlier camera, a tick or so behind at most.
+    if (gLateLatch)
+    {
+        glfwPollEvents();
+        const CameraState latched = gSimulation.SampleLatched(gSimulation.Now());
+        UCameraMatrices(latched, view, projection);
+        ULatchFrameCamera(view, projection, latched.position);
     }
-    else
-        projection = glm::perspective(glm::radians(fov), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
 
-    // Set the shader to be used
-    glUseProgram(gProgramId);
-
-    //Create the Plane
-    glBindVertexArray(meshes.gPlaneMesh.vao);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(5.0f, 1.0f, 4.0f));
-    // 2. Rotate the object
-    rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-    GLint objectColorLoc = glGetUniformLocation(gProgramId, "uObjectColor");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
-    
-    GLint keyColorLoc = glGetUniformLocation(gProgramId, "lightColor");
-    GLint keyPositionLoc = glGetUniformLocation(gProgramId, "lightPos");
-
-    glUniform3f(keyColorLoc, gKeyColor.r, gKeyColor.g, gKeyColor.b);
-    glUniform3f(keyPositionLoc, gKeyPosition.x, gKeyPosition.y, gKeyPosition.z);
-
-    const glm::vec3 cameraPosition = cameraPos;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-    
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureWood);
-
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    UBeginGpuTimer();
 
-    // Watch face
+    // Every mesh lives in the same vertex/index buffers, so one VAO bind covers the frame
+    meshes.BindMeshes();
 
-    glBindVertexArray(meshes.gCylinderMesh.vao);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.4f, 0.03f, 0.4f));
-    // 2. Rotate the object
-    rotation = glm::rotate(0.0f, glm::vec3(1.0, 0.0f, 0.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(0.0f, 0.1f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    // Key Light, drawn first so blended objects in front of it cover it
+    //Transform the smaller cube used as a visual que for the light source
+    model = glm::translate(gKeyPosition) * glm::scale(gKeyScale);
 
-    glProgramUniform4f(gProgramId, objectColorLoc, 0.15f, 0.14f, 0.32f, 1.0f);
+    // Draw the lamp with the Lamp Shader program
+    glUseProgram(gLampId);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureWatchFace);
+    // Pass the model matrix to the Lamp Shader program
+    gLampUniforms.model.Set(model);
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-    glDrawArrays(GL_TRIANGLE_FAN, 36, 36);
-    glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);
+    meshes.DrawMesh(MESH_BOX);
+
+    // Draw every object in the scene with one multi-draw per shader variant and
+    // texture array. Blended variants sort last; they test depth but do not write it.
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectBuffer);
+    GLuint boundProgram = GLuint(gCubePrograms.size());
+    for (const DrawRun& run : gDrawRuns)
+    {
+        const CubeProgram& cube = gCubePrograms[run.program];
+        if (run.program != boundProgram)
+        {
+            if (UPermutationFeatures(cube.key) & MATERIAL_ALPHA)
+            {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glDepthMask(GL_FALSE);
+            }
+
+            glUseProgram(cube.program);
+            cube.uvScale.Set(gUVScale);
+            boundProgram = run.program;
+        }
+
+        if (!gBindless)
+            gTextureLoader.BindArray(run.textureArray);
+        meshes.DrawMeshesIndirect(run.firstCommand, run.commandCount);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
 
     glBindVertexArray(0);
 
-    //Strap 
-    glBindVertexArray(meshes.gBoxMesh.vao);
+    UEndGpuTimer();
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(2.5f, 0.02f, 0.4f));
-    // 2. Rotate the object
-    rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-    // 3. Position the object
-    translation = glm::translate(glm::vec3(0.0f, 0.07f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    UEndFrameUniforms();
 
-    glProgramUniform4f(gProgramId, objectColorLoc, 0.97f, 0.48f, 0.04f, 1.0f);
+    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureLeather);
+    if (gMeasureLatency)
+        UMeasureLatency(gSimulation.SampledInputTime(), gSimulation.Now());
+}
 
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 
-    glBindVertexArray(0);
+// View and projection for a camera from the simulation
+void UCameraMatrices(const CameraState& camera, glm::mat4& view, glm::mat4& projection)
+{
+    // Transforms the camera: move the camera back (z axis)
+    view = glm::lookAt(camera.position, camera.position + camera.front, camera.up);
 
-    // Rubik's Cube
-    glBindVertexArray(meshes.gBoxMesh.vao);
+    if (camera.ortho) {
+        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); //use the orthographic projection for QA
+    }
+    else
+        projection = glm::perspective(glm::radians(fov), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+}
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(1.2f, 1.2f, 1.2f));
-    // 2. Rotate the object
-    rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    // 3. Position the objecta
-    translation = glm::translate(glm::vec3(-2.0f, 0.65f, 1.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-    glProgramUniform4f(gProgramId, objectColorLoc, 0.97f, 0.48f, 0.04f, 1.0f);
+// Point URender at the current program of every shader and resolve its
+// uniforms; after the first link, and again whenever hot reload swaps one
+void UUseLinkedPrograms()
+{
+    for (CubeProgram& cube : gCubePrograms)
+        cube.program = gShaders.Program(cube.shader);
+    gLampId = gShaders.Program(gLampShader);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureCubeFace);
+    // Look every uniform up once so URender never queries by name
+    UResolveUniforms();
 
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once per program)
+    // We set the texture array as texture unit 0 (unused with bindless handles)
+    for (const CubeProgram& cube : gCubePrograms)
+        cube.texture.Set(0);
+}
 
-    glBindVertexArray(0);
 
-    // Ring
-    glBindVertexArray(meshes.gTorusMesh.vao);
+// Resolve the typed handles used by URender from every program's reflected uniforms
+void UResolveUniforms()
+{
+    for (CubeProgram& cube : gCubePrograms)
+    {
+        const UniformTable& cubeTable = gShaders.Uniforms(cube.shader);
+        cube.uvScale = cubeTable.Get<glm::vec2>("uvScale");
+        cube.texture = cubeTable.Get<GLint>("uTextures");
+    }
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.15f, 0.15f, 0.5f));
-    // 2. Rotate the object
-    rotation = glm::rotate(1.55f, glm::vec3(1.0f, 0.0f, 0.0f));
-    // 3. Position the objecta
-    translation = glm::translate(glm::vec3(0.5f, 0.1f, 1.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
+    const UniformTable& lampTable = gShaders.Uniforms(gLampShader);
+    gLampUniforms.model = lampTable.Get<glm::mat4>("model");
+}
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glProgramUniform4f(gProgramId, objectColorLoc, 0.97f, 0.48f, 0.04f, 1.0f);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureCopper);
+// Allocate the ring of per-frame uniforms and map it for the life of the program
+bool UCreateFrameUniforms()
+{
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    gFrameSlotSize = (GLsizeiptr(sizeof(FrameData)) + alignment - 1) / alignment * alignment;
+
+    // Coherent, so a write is seen by the GPU without flushing it
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &gFrameUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, gFrameUbo);
+    glBufferStorage(GL_UNIFORM_BUFFER, gFrameSlotSize * FRAME_UBO_SLOTS, nullptr, flags);
+    gFrameMapping = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, gFrameSlotSize * FRAME_UBO_SLOTS, flags));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    if (!gFrameMapping)
+    {
+        cout << "ERROR: cannot map the frame uniform buffer" << endl;
+        return false;
+    }
+    return true;
+}
 
-    glDrawArrays(GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
-    glBindVertexArray(0);
 
-    // Glass slide
+// This frame's slot in the mapped ring
+FrameData* UFrameSlot()
+{
+    return reinterpret_cast<FrameData*>(gFrameMapping + gFrameSlotSize * gFrameSlot);
+}
 
-    glBindVertexArray(meshes.gTorusMesh.vao);
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.2f, 0.2f, 5.0f));
-    // 2. Rotate the object
-    rotation = glm::rotate(1.8f, glm::vec3(0.0f, 1.0f, 0.0f));
-    // 3. Position the objecta
-    translation = glm::translate(glm::vec3(2.0f, 0.2f, 1.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
+// Move to the next slot, waiting for the GPU to finish the frame that last used it, and bind it
+void UBeginFrameUniforms()
+{
+    gFrameSlot = (gFrameSlot + 1) % FRAME_UBO_SLOTS;
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glProgramUniform4f(gProgramId, objectColorLoc, 0.97f, 0.48f, 0.04f, 1.0f);
+    GLsync& fence = gFrameFences[gFrameSlot];
+    if (fence)
+    {
+        // Normally long signalled: the frames in between have been submitted since
+        GLenum status;
+        do
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        while (status == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fence);
+        fence = 0;
+    }
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureGlass);
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, gFrameUbo, gFrameSlotSize * gFrameSlot, sizeof(FrameData));
+}
 
-    glDrawArrays(GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
-    glBindVertexArray(0);
 
+// Write this frame's camera and light state into its slot
+void UUpdateFrameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition)
+{
+    FrameData frame = {};
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPosition = glm::vec4(viewPosition, 1.0f);
+    frame.lightColor = glm::vec4(gKeyColor, 1.0f);
+    frame.lightPos = glm::vec4(gKeyPosition, 1.0f);
+    frame.time = static_cast<float>(glfwGetTime());
+    const size_t pointLights = std::min(gScene.lightPositions.size(), size_t(MAX_POINT_LIGHTS));
+    for (size_t i = 0; i < pointLights; i++)
+    {
+        frame.pointLightPositions[i] = glm::vec4(gScene.lightPositions[i], 1.0f);
+        frame.pointLightColors[i] = glm::vec4(gScene.lightColors[i], 1.0f);
+    }
 
-    // Spacer to prevent artifacting
+    *UFrameSlot() = frame;
+}
 
-    glBindVertexArray(meshes.gTorusMesh.vao);
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.01f, 0.01f, 0.01f));
-    // 2. Rotate the object
-    rotation = glm::rotate(1.8f, glm::vec3(0.0f, 1.0f, 0.0f));
-    // 3. Position the objecta
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = translation * rotation * scale;
+// Overwrite only the camera in this frame's slot. Call it before any command
+// that reads the slot is issued: a coherent write is only guaranteed to reach
+// commands issued after it. The slot itself is safe to write, since
+// UBeginFrameUniforms waited for the last frame that read it.
+void ULatchFrameCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition)
+{
+    FrameData* frame = UFrameSlot();
+    frame->view = view;
+    frame->projection = projection;
+    frame->viewPosition = glm::vec4(viewPosition, 1.0f);
+}
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glProgramUniform4f(gProgramId, objectColorLoc, 0.97f, 0.48f, 0.04f, 1.0f);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureCopper);
+// Fence the slot once the frame's commands are all issued, so it is not reused before they ran
+void UEndFrameUniforms()
+{
+    gFrameFences[gFrameSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
 
-    glDrawArrays(GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
-    glBindVertexArray(0);
 
-    // Key Light
-    glBindVertexArray(meshes.gBoxMesh.vao);
+void UDestroyFrameUniforms()
+{
+    for (GLsync& fence : gFrameFences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, gFrameUbo);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    gFrameMapping = nullptr;
 
-    //Transform the smaller cube used as a visual que for the light source
-    model = glm::translate(gKeyPosition) * glm::scale(gKeyScale);
+    glDeleteBuffers(1, &gFrameUbo);
+}
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampId, "model");
-    viewLoc = glGetUniformLocation(gLampId, "view");
-    projLoc = glGetUniformLocation(gLampId, "projection");
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+// Time from the input reflected in the frame, blended like its camera, to
+// SwapBuffers returning. Frames without new input are skipped, since nothing
+// is waiting on them.
+void UMeasureLatency(double inputTime, double swapTime)
+{
+    if (inputTime <= gLatencyInputTime)
+        return;
+    gLatencyInputTime = inputTime;
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gBoxMesh.nVertices);
+    const double latency = swapTime - inputTime;
+    gLatencyTotal += latency;
+    gLatencyMax = std::max(gLatencyMax, latency);
+    gLatencySamples++;
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    if (gLatencySamples == 120)
+    {
+        cout << "LATENCY: input to SwapBuffers return " << (gLatencyTotal / gLatencySamples) * 1.0e3 << " ms avg, " << gLatencyMax * 1.0e3
+            << " ms max (" << gLatencySamples << " frames" << (gLateLatch ? ", late latched)" : ")") << endl;
+        gLatencyTotal = 0.0;
+        gLatencyMax = 0.0;
+        gLatencySamples = 0;
+    }
 }
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+
+// Inverse transpose of the model matrix's upper 3x3, used to bring normals into world space.
+// The columns of the inverse transpose are the cross products of the other two columns
+// divided by the determinant, which avoids a general 4x4 inverse.
+glm::mat3 UNormalMatrix(const glm::mat4& model)
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
+    const glm::vec3 c0(model[0]);
+    const glm::vec3 c1(model[1]);
+    const glm::vec3 c2(model[2]);
+
+    // Fast path: rotation with a uniform scale s has orthogonal columns of equal length,
+    // and its inverse transpose is simply the matrix divided by s^2
+    const float len0 = glm::dot(c0, c0);
+    const float tolerance = 1e-5f * len0;
+    if (fabs(glm::dot(c0, c1)) <= tolerance && fabs(glm::dot(c0, c2)) <= tolerance && fabs(glm::dot(c1, c2)) <= tolerance
+        && fabs(glm::dot(c1, c1) - len0) <= tolerance && fabs(glm::dot(c2, c2) - len0) <= tolerance && len0 > 0.0f)
     {
-        //flipImageVertically(image, width, height, channels);
-
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
+        return glm::mat3(c0, c1, c2) * (1.0f / len0);
+    }
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+    const glm::vec3 r0 = glm::cross(c1, c2);
+    const glm::vec3 r1 = glm::cross(c2, c0);
+    const glm::vec3 r2 = glm::cross(c0, c1);
+    const float det = glm::dot(c0, r0);
+    if (det == 0.0f)
+        return glm::mat3(r0, r1, r2);   // degenerate scale; direction is all the shader needs
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+    return glm::mat3(r0, r1, r2) * (1.0f / det);
+}
 
-        return true;
-    }
 
-    // Error loading the image
-    return false;
+// Request the scene shader variant each object's material features need,
+// once per distinct permutation; the driver compiles them in the background
+void URequestCubePrograms()
+{
+    if (gScene.lightPositions.size() > MAX_POINT_LIGHTS)
+        cout << "WARNING: scene has " << gScene.lightPositions.size() << " lights, only the first " << MAX_POINT_LIGHTS << " are shaded" << endl;
+    const GLuint pointLights = GLuint(std::min(gScene.lightPositions.size(), size_t(MAX_POINT_LIGHTS)));
+
+    std::vector<PermutationKey> keys;
+    for (GLuint features : gScene.features)
+        keys.push_back(UPermutationKey(features, pointLights));
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    gCubePrograms.clear();
+    for (PermutationKey key : keys)
+    {
+        CubeProgram cube = {};
+        cube.key = key;
+        cube.shader = gPermutations.Request(key);
+        gCubePrograms.push_back(cube);
+    }
 }
 
-void UDestroyTexture(GLuint textureId)
+
+// Index into gCubePrograms of the variant for an object
+GLuint UCubeProgramIndex(GLuint object)
 {
-    glGenTextures(1, &textureId);
+    const GLuint pointLights = GLuint(std::min(gScene.lightPositions.size(), size_t(MAX_POINT_LIGHTS)));
+    const PermutationKey key = UPermutationKey(gScene.features[object], pointLights);
+    return GLuint(std::lower_bound(gCubePrograms.begin(), gCubePrograms.end(), key,
+        [](const CubeProgram& cube, PermutationKey value) { return cube.key < value; }) - gCubePrograms.begin());
 }
 
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+
+// Sort the scene objects by shader variant and mesh and precompute what level
+// of detail selection needs. The buffers are sized for the worst case here and
+// filled by UUpdateDrawCommands.
+void UBuildInstanceBatches()
 {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
+    const GLuint objectCount = gScene.ObjectCount();
 
-    // Create a Shader program object.
-    programId = glCreateProgram();
+    std::vector<GLuint> programs(objectCount);
+    std::vector<GLuint> order(objectCount);
+    for (GLuint i = 0; i < objectCount; i++)
+    {
+        programs[i] = UCubeProgramIndex(i);
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+        if (programs[a] != programs[b])
+            return programs[a] < programs[b];
+        return gScene.meshTypes[a] < gScene.meshTypes[b];
+    });
+
+    gDrawObjects.resize(objectCount);
+    for (GLuint i = 0; i < objectCount; i++)
+    {
+        const GLuint object = order[i];
+        const glm::mat4& model = gScene.models[object];
+        const glm::mat3 normalMatrix = UNormalMatrix(model);
+
+        DrawObject& draw = gDrawObjects[i];
+        draw.instance.model = model;
+        for (int column = 0; column < 3; column++)
+            draw.instance.normalMatrix[column] = glm::vec4(normalMatrix[column], 0.0f);
+        draw.instance.tint = gScene.tints[object];
+        draw.instance.material = gMaterials[gScene.textureIndices[object]];
+        draw.program = programs[object];
+        draw.textured = (gScene.features[object] & MATERIAL_TEXTURED) != 0;
+        draw.textureArray = 0;
+
+        draw.mesh = gScene.meshTypes[object];
+
+        const float scale = glm::max(glm::length(glm::vec3(model[0])),
+            glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        draw.center = glm::vec3(model * glm::vec4(meshes.GetBoundsCenter(draw.mesh), 1.0f));
+        draw.radius = meshes.GetBoundsRadius(draw.mesh) * scale;
+        draw.scale = scale;
+        draw.lod = MESH_LOD_COUNT;  // forces the first UUpdateDrawCommands to fill the buffers
+    }
 
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+    // At most one command per object
+    glGenBuffers(1, &gInstanceVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(MeshInstance) * objectCount, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+    meshes.AttachInstanceBuffer(gInstanceVbo);
 
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
+    glGenBuffers(1, &gIndirectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * objectCount, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+
+// Choose every object's level of detail from the projected size of its bounding
+// sphere, then rewrite the instance and indirect buffers if any level, or the
+// texture array holding any material, changed. Works for both projections: an
+// orthographic projection has no divide by depth.
+void UUpdateDrawCommands(const glm::mat4& view, const glm::mat4& projection)
+{
+    // Pixels covered by one world unit at view depth 1
+    const float pixelsPerUnit = projection[1][1] * WINDOW_HEIGHT * 0.5f;
+    const bool perspective = projection[3][3] == 0.0f;
+
+    bool changed = false;
+    for (DrawObject& draw : gDrawObjects)
     {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        float depth = 1.0f;
+        if (perspective)
+        {
+            // Nearest point of the bounding sphere, kept in front of the near plane
+            const float centerDepth = -(view * glm::vec4(draw.center, 1.0f)).z;
+            depth = glm::max(centerDepth - draw.radius, 0.1f);
+        }
 
-        return false;
+        // Every object is drawn, so every material a textured variant samples
+        // stays resident. The texture spans the object about once per UV repeat,
+        // so the projected diameter over the repeat count sizes the mip level it needs.
+        if (draw.textured)
+        {
+            const float footprint = 2.0f * draw.radius * pixelsPerUnit / depth / glm::max(gUVScale.x, gUVScale.y);
+            gTextureLoader.UseMaterial(draw.instance.material, footprint);
+
+            // Its image arriving moves the material from the placeholder's array to its own
+            const GLuint textureArray = gTextureLoader.MaterialArray(draw.instance.material);
+            changed |= textureArray != draw.textureArray;
+            draw.textureArray = textureArray;
+        }
+
+        const GLuint lod = meshes.SelectLod(draw.mesh, pixelsPerUnit * draw.scale / depth, LOD_PIXEL_ERROR);
+        changed |= lod != draw.lod;
+        draw.lod = lod;
     }
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
+    if (!changed)
+        return;
+
+    // The material a draw command has to share: its handle is what bindless
+    // variants sample, while array variants index the bound array per instance
+    auto commandMaterial = [](const DrawObject& draw) {
+        return gBindless && draw.textured ? draw.instance.material : 0;
+    };
+
+    // Within each variant, group the objects by texture array, then by material
+    // on the bindless path, then by mesh and level
+    const GLuint objectCount = GLuint(gDrawObjects.size());
+    std::vector<GLuint> order(objectCount);
+    for (GLuint i = 0; i < objectCount; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+        const DrawObject& first = gDrawObjects[a];
+        const DrawObject& second = gDrawObjects[b];
+        if (first.program != second.program)
+            return first.program < second.program;
+        if (first.textureArray != second.textureArray)
+            return first.textureArray < second.textureArray;
+        if (commandMaterial(first) != commandMaterial(second))
+            return commandMaterial(first) < commandMaterial(second);
+        if (first.mesh != second.mesh)
+            return first.mesh < second.mesh;
+        return first.lod < second.lod;
+    });
+
+    gDrawRuns.clear();
+
+    std::vector<MeshInstance> instances(objectCount);
+    std::vector<DrawElementsIndirectCommand> commands;
+    MeshType commandMesh = MESH_COUNT;
+    GLuint commandLod = MESH_LOD_COUNT;
+    GLuint material = 0;
+    for (GLuint i = 0; i < objectCount; i++)
     {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        const DrawObject& draw = gDrawObjects[order[i]];
+        instances[i] = draw.instance;
 
-        return false;
+        const bool newRun = gDrawRuns.empty() || draw.program != gDrawRuns.back().program ||
+            draw.textureArray != gDrawRuns.back().textureArray;
+        if (newRun)
+            gDrawRuns.push_back({ draw.program, draw.textureArray, GLuint(commands.size()), 0 });
+
+        if (newRun || draw.mesh != commandMesh || draw.lod != commandLod || commandMaterial(draw) != material)
+        {
+            // baseInstance selects this command's entries in gInstanceVbo
+            commands.push_back(meshes.GetDrawCommand(draw.mesh, draw.lod, 0, i));
+            gDrawRuns.back().commandCount++;
+            commandMesh = draw.mesh;
+            commandLod = draw.lod;
+            material = commandMaterial(draw);
+        }
+        commands.back().instanceCount++;
     }
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(MeshInstance) * instances.size(), instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * commands.size(), commands.data());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
 
-        return false;
+
+void UDestroyInstanceBatches()
+{
+    glDeleteBuffers(1, &gInstanceVbo);
+    glDeleteBuffers(1, &gIndirectBuffer);
+    gDrawObjects.clear();
+    gDrawRuns.clear();
+}
+
+
+// Start timing the scene pass on the GPU
+void UBeginGpuTimer()
+{
+    if (!gBenchmark)
+        return;
+
+    glBeginQuery(GL_TIME_ELAPSED, gTimerQueries[gTimerFrame & 1]);
+}
+
+
+// Stop timing and collect the previous frame's result once it is available
+void UEndGpuTimer()
+{
+    if (!gBenchmark)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    gTimerFrame++;
+
+    GLuint previous = gTimerQueries[gTimerFrame & 1];
+    GLint available = 0;
+    if (gTimerFrame < 2)
+        return;
+    glGetQueryObjectiv(previous, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(previous, GL_QUERY_RESULT, &elapsed);
+    gGpuTimeTotal += elapsed;
+    gGpuTimeSamples++;
+
+    if (gGpuTimeSamples == 120)
+    {
+        cout << "BENCH: scene pass " << (gGpuTimeTotal / gGpuTimeSamples) / 1.0e6 << " ms (GPU, avg of " << gGpuTimeSamples << " frames)" << endl;
+        gGpuTimeTotal = 0;
+        gGpuTimeSamples = 0;
     }
+}
 
-    glUseProgram(programId);    // Uses the shader program
 
-    return true;
+// Report what the texture registry holds; printed once every texture has arrived
+void UPrintTextureStats()
+{
+    const TextureStats stats = gTextureLoader.Stats();
+    cout << "Textures: " << stats.materials << " materials, " << stats.images << " images ("
+        << stats.opaqueImages << " BC1, " << stats.pathHits << " repeated paths, " << stats.contentHits << " identical images), "
+        << stats.streamedBytes / 1024 << " KB streamed in, " << stats.allocatedBytes / 1024 << " KB allocated" << endl;
 }
 
 
-void UDestroyShaderProgram(GLuint programId)
+// Time the CPU mip chain (box and Kaiser, split across a thread pool) against
+// glGenerateMipmap on an sRGB texture for every image in the scene. The CPU
+// times leave out the upload the driver path does not need.
+void UBenchmarkMipmaps()
 {
-    glDeleteProgram(programId);
+    typedef std::chrono::steady_clock Clock;
+    ThreadPool pool;
+    pool.Start(0);
+
+    for (const string& path : gScene.texturePaths)
+    {
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+        if (!pixels)
+        {
+            cout << "BENCH: cannot load " << path << endl;
+            continue;
+        }
+
+        std::vector<unsigned char> chain;
+        double cpuMs[2];
+        const MipFilter filters[2] = { MIP_FILTER_BOX, MIP_FILTER_KAISER };
+        for (int f = 0; f < 2; f++)
+        {
+            const Clock::time_point start = Clock::now();
+            UBuildMipChain(pixels, width, height, filters[f], &pool, chain);
+            cpuMs[f] = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        GLsizei levels = 1;
+        for (int size = std::max(width, height); size > 1; size /= 2)
+            levels++;
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_SRGB8_ALPHA8, width, height);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glFinish();
+
+        const Clock::time_point start = Clock::now();
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glFinish();
+        const double gpuMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDeleteTextures(1, &texture);
+        stbi_image_free(pixels);
+
+        cout << "BENCH: " << path << " " << width << "x" << height
+            << " box " << cpuMs[0] << " ms, kaiser " << cpuMs[1] << " ms (CPU, "
+            << pool.WorkerCount() << " workers + caller), glGenerateMipmap " << gpuMs << " ms" << endl;
+    }
+
+    pool.Stop();
 }
\ No newline at end of file
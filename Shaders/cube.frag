@@ -0,0 +1,87 @@
+#version 440 core
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+
+in vec3 vertexNormal; // For incoming normals
+in vec3 vertexFragmentPos; // For incoming fragment position
+in vec2 vertexTextureCoordinate;
+in vec4 vertexTint;
+flat in uint vertexMaterial;
+
+out vec4 fragmentColor; // For outgoing cube color to the GPU
+
+#include "frame.glsl"
+#include "materials.glsl"
+
+// Material features are chosen per permutation by the application (see
+// permutations.h); whatever a permutation leaves out is never evaluated:
+// MATERIAL_TEXTURED, MATERIAL_SPECULAR, MATERIAL_KEY_LIGHT, MATERIAL_ALPHA and
+// POINT_LIGHT_COUNT
+#ifndef POINT_LIGHT_COUNT
+#define POINT_LIGHT_COUNT 0
+#endif
+
+uniform vec2 uvScale;
+
+const float ambientStrength = 0.1f; // Set ambient or global lighting strength
+const float specularIntensity = 2.0f; // Set specular light strength
+const float highlightSize = 10.0f; // Set specular highlight size
+
+// Diffuse, and in specular permutations specular, light from one light
+vec3 Shade(vec3 lightPosition, vec3 color, vec3 norm)
+{
+    vec3 lightDirection = normalize(lightPosition - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+    float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
+    vec3 result = impact * color; // Generate diffuse light color
+
+#ifdef MATERIAL_SPECULAR
+    vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos); // Calculate view direction
+    vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+    result += specularIntensity * specularComponent * color;
+#endif
+    return result;
+}
+
+void main()
+{
+    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+
+    // Texture holds the color to be used for all three components
+#ifdef MATERIAL_TEXTURED
+    vec4 baseColor = SampleMaterial(vertexMaterial, vertexTextureCoordinate * uvScale) * vertexTint;
+#else
+    vec4 baseColor = vertexTint;
+#endif
+
+    //Calculate Ambient lighting*/
+    vec3 light = ambientStrength * lightColor.rgb; // Generate ambient light color
+
+#if defined(MATERIAL_KEY_LIGHT) || POINT_LIGHT_COUNT > 0
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+#endif
+
+#ifdef MATERIAL_KEY_LIGHT
+    light += Shade(lightPos.xyz, lightColor.rgb, norm);
+#endif
+
+#if POINT_LIGHT_COUNT > 0
+    // Point lights fade with distance; the key light does not
+    for (int i = 0; i < POINT_LIGHT_COUNT; i++)
+    {
+        float lightDistance = length(pointLightPositions[i].xyz - vertexFragmentPos);
+        float attenuation = 1.0 / (1.0 + 0.09 * lightDistance + 0.032 * lightDistance * lightDistance);
+        light += attenuation * Shade(pointLightPositions[i].xyz, pointLightColors[i].rgb, norm);
+    }
+#endif
+
+    // Calculate phong result
+    vec3 phong = light * baseColor.rgb;
+
+#ifdef MATERIAL_ALPHA
+    fragmentColor = vec4(phong, baseColor.a);
+#else
+    fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+#endif
+}
@@ -0,0 +1,31 @@
+#version 440 core
+
+layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout(location = 1) in vec3 normal; // VAP position 1 for normals
+layout(location = 2) in vec2 textureCoordinate;
+
+// Per-instance attributes (see MeshInstance)
+layout(location = 3) in mat4 model; // locations 3-6
+layout(location = 7) in mat3 normalMatrix; // locations 7-9, inverse transpose of the model matrix computed on the CPU
+layout(location = 10) in vec4 tint;
+layout(location = 11) in uint material; // texture array layer or bindless handle index
+
+out vec3 vertexNormal; // For outgoing normals to fragment shader
+out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+out vec2 vertexTextureCoordinate;
+out vec4 vertexTint;
+flat out uint vertexMaterial;
+
+#include "frame.glsl"
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+
+    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = normalMatrix * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexTextureCoordinate = textureCoordinate;
+    vertexTint = tint;
+    vertexMaterial = material;
+}
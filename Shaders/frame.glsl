@@ -0,0 +1,14 @@
+// Per-frame camera and light state, shared with every program (see FrameData
+// in Project.cpp). FRAME_UBO_BINDING and MAX_POINT_LIGHTS are defined by the
+// application.
+layout(std140, binding = FRAME_UBO_BINDING) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPosition;
+    vec4 lightColor;
+    vec4 lightPos;
+    float time;
+    vec4 pointLightPositions[MAX_POINT_LIGHTS]; // xyz; the first POINT_LIGHT_COUNT are used
+    vec4 pointLightColors[MAX_POINT_LIGHTS];    // rgb
+};
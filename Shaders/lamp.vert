@@ -0,0 +1,13 @@
+#version 440 core
+
+layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+#include "frame.glsl"
+
+//Uniform / Global variables for the  transform matrices
+uniform mat4 model;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+}
@@ -0,0 +1,28 @@
+// Material sampling for scene objects. Every material is either a bindless
+// handle (BINDLESS_TEXTURES defined, which also needs the extension enabled
+// before any declaration) or a layer of the texture array bound for its draw;
+// the table layout matches TextureLoader's material SSBO at MATERIAL_SSBO_BINDING.
+#ifdef BINDLESS_TEXTURES
+
+layout(std430, binding = MATERIAL_SSBO_BINDING) readonly buffer Materials { uvec2 materialHandles[]; };
+
+vec4 SampleMaterial(uint material, vec2 uv)
+{
+    return texture(sampler2D(materialHandles[material]), uv);
+}
+
+#else
+
+uniform sampler2DArray uTextures; // The array of every material in the draw, one layer each
+
+struct ArrayMaterial { uint layer; float minLod; }; // minLod: finest level streamed in
+layout(std430, binding = MATERIAL_SSBO_BINDING) readonly buffer Materials { ArrayMaterial materials[]; };
+
+vec4 SampleMaterial(uint material, vec2 uv)
+{
+    ArrayMaterial entry = materials[material];
+    float lod = max(textureQueryLod(uTextures, uv).y, entry.minLod);
+    return textureLod(uTextures, vec3(uv, float(entry.layer)), lod);
+}
+
+#endif
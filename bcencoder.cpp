@@ -0,0 +1,394 @@
+///////////////////////////////////////////////////////////////////////////////
+// bcencoder.cpp
+// ========
+// CPU encoders for the S3TC block compressed formats: BC1 (DXT1) for opaque
+// images and BC3 (DXT5) for images with alpha
+//
+// Endpoints come from the block's bounding box, with the box diagonal chosen
+// from the sign of each channel's covariance against the widest channel and
+// inset by 1/16 of the range. This is the usual fast "range fit": far cheaper
+// than a cluster fit and close to it on photographic textures. With SSE2 the
+// bounds and the search for each pixel's nearest palette entry run on several
+// pixels per instruction.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bcencoder.h"
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BC_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Gather a 4x4 block of RGBA8 pixels, repeating the last row/column past the edges
+	void LoadBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, unsigned char block[64])
+	{
+		for (int y = 0; y < 4; y++)
+		{
+			const int sourceY = blockY * 4 + y < height ? blockY * 4 + y : height - 1;
+			for (int x = 0; x < 4; x++)
+			{
+				const int sourceX = blockX * 4 + x < width ? blockX * 4 + x : width - 1;
+				const unsigned char* pixel = rgba + (size_t(sourceY) * width + sourceX) * 4;
+				unsigned char* target = block + (y * 4 + x) * 4;
+				target[0] = pixel[0];
+				target[1] = pixel[1];
+				target[2] = pixel[2];
+				target[3] = pixel[3];
+			}
+		}
+	}
+
+	// Per channel minimum and maximum over the 16 pixels of a block
+	void BlockBounds(const unsigned char block[64], unsigned char low[4], unsigned char high[4])
+	{
+#ifdef BC_USE_SSE2
+		// 4 pixels per register; fold the 4 registers, then the 4 pixels within one
+		const __m128i* rows = reinterpret_cast<const __m128i*>(block);
+		__m128i minimum = _mm_min_epu8(_mm_min_epu8(_mm_loadu_si128(rows + 0), _mm_loadu_si128(rows + 1)),
+			_mm_min_epu8(_mm_loadu_si128(rows + 2), _mm_loadu_si128(rows + 3)));
+		__m128i maximum = _mm_max_epu8(_mm_max_epu8(_mm_loadu_si128(rows + 0), _mm_loadu_si128(rows + 1)),
+			_mm_max_epu8(_mm_loadu_si128(rows + 2), _mm_loadu_si128(rows + 3)));
+
+		minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 8));
+		minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 4));
+		maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 8));
+		maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 4));
+
+		const uint32_t lowBits = uint32_t(_mm_cvtsi128_si32(minimum));
+		const uint32_t highBits = uint32_t(_mm_cvtsi128_si32(maximum));
+		for (int channel = 0; channel < 4; channel++)
+		{
+			low[channel] = (unsigned char)(lowBits >> (channel * 8));
+			high[channel] = (unsigned char)(highBits >> (channel * 8));
+		}
+#else
+		for (int channel = 0; channel < 4; channel++)
+		{
+			low[channel] = 255;
+			high[channel] = 0;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			for (int channel = 0; channel < 4; channel++)
+			{
+				const unsigned char value = block[i * 4 + channel];
+				if (value < low[channel])
+					low[channel] = value;
+				if (value > high[channel])
+					high[channel] = value;
+			}
+		}
+#endif
+	}
+
+	inline uint16_t PackRGB565(const int color[3])
+	{
+		const int r = (color[0] * 31 + 127) / 255;
+		const int g = (color[1] * 63 + 127) / 255;
+		const int b = (color[2] * 31 + 127) / 255;
+		return uint16_t((r << 11) | (g << 5) | b);
+	}
+
+	// Expand 5/6 bit channels back to 8 bits the way the hardware does
+	inline void UnpackRGB565(uint16_t packed, int color[3])
+	{
+		const int r = (packed >> 11) & 31;
+		const int g = (packed >> 5) & 63;
+		const int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	inline void WriteLE16(unsigned char* out, uint16_t value)
+	{
+		out[0] = (unsigned char)(value & 0xFF);
+		out[1] = (unsigned char)(value >> 8);
+	}
+
+	// 2 bit index of the nearest of the 4 palette colors for each pixel, pixel 0
+	// in the low bits; ties go to the lower entry
+	uint32_t ColorIndices(const unsigned char block[64], const int palette[4][3])
+	{
+		uint32_t indices = 0;
+#ifdef BC_USE_SSE2
+		// Pixels widen to 16 bit RGBA, two per half register, with alpha masked
+		// to 0 so madd sums only the RGB squares; a row of 4 pixels is searched at once
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rgbMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+		__m128i entries[4];
+		for (int entry = 0; entry < 4; entry++)
+		{
+			const short r = short(palette[entry][0]), g = short(palette[entry][1]), b = short(palette[entry][2]);
+			entries[entry] = _mm_set_epi16(0, b, g, r, 0, b, g, r);
+		}
+
+		const __m128i* rows = reinterpret_cast<const __m128i*>(block);
+		for (int row = 0; row < 4; row++)
+		{
+			const __m128i pixels = _mm_loadu_si128(rows + row);
+			const __m128i first = _mm_and_si128(_mm_unpacklo_epi8(pixels, zero), rgbMask);
+			const __m128i second = _mm_and_si128(_mm_unpackhi_epi8(pixels, zero), rgbMask);
+
+			__m128i best = zero, bestIndex = zero;
+			for (int entry = 0; entry < 4; entry++)
+			{
+				const __m128i firstDelta = _mm_sub_epi16(first, entries[entry]);
+				const __m128i secondDelta = _mm_sub_epi16(second, entries[entry]);
+				__m128i firstSquares = _mm_madd_epi16(firstDelta, firstDelta);     // r2 + g2, b2 per pixel
+				__m128i secondSquares = _mm_madd_epi16(secondDelta, secondDelta);
+				firstSquares = _mm_add_epi32(firstSquares, _mm_srli_epi64(firstSquares, 32));
+				secondSquares = _mm_add_epi32(secondSquares, _mm_srli_epi64(secondSquares, 32));
+				const __m128i distance = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(firstSquares),
+					_mm_castsi128_ps(secondSquares), _MM_SHUFFLE(2, 0, 2, 0)));
+
+				if (entry == 0)
+				{
+					best = distance;
+					continue;
+				}
+				const __m128i closer = _mm_cmplt_epi32(distance, best);
+				best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+				bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(entry)), _mm_andnot_si128(closer, bestIndex));
+			}
+
+			uint32_t lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+			indices |= (lanes[0] | lanes[1] << 2 | lanes[2] << 4 | lanes[3] << 6) << (row * 8);
+		}
+#else
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestDistance = 0x7FFFFFFF;
+			for (int entry = 0; entry < 4; entry++)
+			{
+				int distance = 0;
+				for (int channel = 0; channel < 3; channel++)
+				{
+					const int delta = block[i * 4 + channel] - palette[entry][channel];
+					distance += delta * delta;
+				}
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					best = entry;
+				}
+			}
+			indices |= uint32_t(best) << (i * 2);
+		}
+#endif
+		return indices;
+	}
+
+	// 3 bit index of the nearest of the 8 palette alphas for each pixel, pixel 0
+	// in the low bits; ties go to the lower entry
+	uint64_t AlphaIndices(const unsigned char block[64], const int palette[8])
+	{
+		uint64_t indices = 0;
+#ifdef BC_USE_SSE2
+		// All 16 alphas in one register; a distance always fits a byte
+		const __m128i* rows = reinterpret_cast<const __m128i*>(block);
+		const __m128i alphas = _mm_packus_epi16(
+			_mm_packs_epi32(_mm_srli_epi32(_mm_loadu_si128(rows + 0), 24), _mm_srli_epi32(_mm_loadu_si128(rows + 1), 24)),
+			_mm_packs_epi32(_mm_srli_epi32(_mm_loadu_si128(rows + 2), 24), _mm_srli_epi32(_mm_loadu_si128(rows + 3), 24)));
+
+		__m128i best = _mm_setzero_si128(), bestIndex = _mm_setzero_si128();
+		for (int entry = 0; entry < 8; entry++)
+		{
+			const __m128i value = _mm_set1_epi8(char(palette[entry]));
+			const __m128i distance = _mm_or_si128(_mm_subs_epu8(alphas, value), _mm_subs_epu8(value, alphas));
+			if (entry == 0)
+			{
+				best = distance;
+				continue;
+			}
+			const __m128i closer = _mm_andnot_si128(_mm_cmpeq_epi8(distance, best),
+				_mm_cmpeq_epi8(_mm_min_epu8(distance, best), distance));
+			best = _mm_min_epu8(distance, best);
+			bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi8(char(entry))), _mm_andnot_si128(closer, bestIndex));
+		}
+
+		unsigned char lanes[16];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+		for (int i = 0; i < 16; i++)
+			indices |= uint64_t(lanes[i]) << (i * 3);
+#else
+		for (int i = 0; i < 16; i++)
+		{
+			const int alpha = block[i * 4 + 3];
+			int best = 0;
+			int bestDistance = 256;
+			for (int entry = 0; entry < 8; entry++)
+			{
+				const int distance = alpha > palette[entry] ? alpha - palette[entry] : palette[entry] - alpha;
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					best = entry;
+				}
+			}
+			indices |= uint64_t(best) << (i * 3);
+		}
+#endif
+		return indices;
+	}
+
+	// BC1 color block: two RGB565 endpoints and a 2 bit palette index per pixel
+	void EncodeColorBlock(const unsigned char block[64], unsigned char out[8])
+	{
+		unsigned char low[4], high[4];
+		BlockBounds(block, low, high);
+
+		// Widest channel decides the axis; the others follow it or run against it
+		int axis = 0;
+		for (int channel = 1; channel < 3; channel++)
+		{
+			if (high[channel] - low[channel] > high[axis] - low[axis])
+				axis = channel;
+		}
+
+		int mean[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+			for (int channel = 0; channel < 3; channel++)
+				mean[channel] += block[i * 4 + channel];
+
+		int covariance[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			const int axisDelta = block[i * 4 + axis] * 16 - mean[axis];
+			for (int channel = 0; channel < 3; channel++)
+				covariance[channel] += (block[i * 4 + channel] * 16 - mean[channel]) * axisDelta;
+		}
+
+		int endpoint0[3], endpoint1[3];
+		for (int channel = 0; channel < 3; channel++)
+		{
+			const int inset = (high[channel] - low[channel]) / 16;
+			const int top = high[channel] - inset;
+			const int bottom = low[channel] + inset;
+			endpoint0[channel] = covariance[channel] < 0 ? bottom : top;
+			endpoint1[channel] = covariance[channel] < 0 ? top : bottom;
+		}
+
+		uint16_t color0 = PackRGB565(endpoint0);
+		uint16_t color1 = PackRGB565(endpoint1);
+
+		// color0 > color1 selects the 4 color (opaque) palette
+		if (color0 < color1)
+		{
+			const uint16_t swap = color0;
+			color0 = color1;
+			color1 = swap;
+		}
+
+		WriteLE16(out + 0, color0);
+		WriteLE16(out + 2, color1);
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			int palette[4][3];
+			UnpackRGB565(color0, palette[0]);
+			UnpackRGB565(color1, palette[1]);
+			for (int channel = 0; channel < 3; channel++)
+			{
+				palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+				palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+			}
+
+			indices = ColorIndices(block, palette);
+		}
+
+		out[4] = (unsigned char)(indices & 0xFF);
+		out[5] = (unsigned char)((indices >> 8) & 0xFF);
+		out[6] = (unsigned char)((indices >> 16) & 0xFF);
+		out[7] = (unsigned char)(indices >> 24);
+	}
+
+	// BC3 alpha block: two 8 bit endpoints and a 3 bit palette index per pixel
+	void EncodeAlphaBlock(const unsigned char block[64], unsigned char out[8])
+	{
+		int alpha0 = 0, alpha1 = 255;
+		for (int i = 0; i < 16; i++)
+		{
+			const int alpha = block[i * 4 + 3];
+			if (alpha > alpha0)
+				alpha0 = alpha;
+			if (alpha < alpha1)
+				alpha1 = alpha;
+		}
+
+		out[0] = (unsigned char)alpha0;
+		out[1] = (unsigned char)alpha1;
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			// alpha0 > alpha1 selects the 8 value palette
+			int palette[8];
+			palette[0] = alpha0;
+			palette[1] = alpha1;
+			for (int step = 1; step < 7; step++)
+				palette[step + 1] = ((7 - step) * alpha0 + step * alpha1) / 7;
+
+			indices = AlphaIndices(block, palette);
+		}
+
+		for (int byte = 0; byte < 6; byte++)
+			out[2 + byte] = (unsigned char)((indices >> (byte * 8)) & 0xFF);
+	}
+}
+
+size_t UBlockCompressedSize(int width, int height, size_t blockBytes)
+{
+	const size_t blocksWide = size_t(width + 3) / 4;
+	const size_t blocksHigh = size_t(height + 3) / 4;
+	return (blocksWide > 0 ? blocksWide : 1) * (blocksHigh > 0 ? blocksHigh : 1) * blockBytes;
+}
+
+///////////////////////////////////////////////////
+//	UEncodeBC1(const unsigned char*, int, int, unsigned char*)
+//
+//	rgba: image to encode; alpha is ignored
+//	out: receives the blocks in row order
+///////////////////////////////////////////////////
+void UEncodeBC1(const unsigned char* rgba, int width, int height, unsigned char* out)
+{
+	unsigned char block[64];
+	for (int blockY = 0; blockY < (height + 3) / 4; blockY++)
+	{
+		for (int blockX = 0; blockX < (width + 3) / 4; blockX++)
+		{
+			LoadBlock(rgba, width, height, blockX, blockY, block);
+			EncodeColorBlock(block, out);
+			out += BC1_BLOCK_BYTES;
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	UEncodeBC3(const unsigned char*, int, int, unsigned char*)
+//
+//	rgba: image to encode
+//	out: receives the blocks in row order, each an
+//	alpha block followed by a color block
+///////////////////////////////////////////////////
+void UEncodeBC3(const unsigned char* rgba, int width, int height, unsigned char* out)
+{
+	unsigned char block[64];
+	for (int blockY = 0; blockY < (height + 3) / 4; blockY++)
+	{
+		for (int blockX = 0; blockX < (width + 3) / 4; blockX++)
+		{
+			LoadBlock(rgba, width, height, blockX, blockY, block);
+			EncodeAlphaBlock(block, out);
+			EncodeColorBlock(block, out + 8);
+			out += BC3_BLOCK_BYTES;
+		}
+	}
+}
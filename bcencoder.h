@@ -0,0 +1,23 @@
+///////////////////////////////////////////////////////////////////////////////
+// bcencoder.h
+// ========
+// CPU encoders for the S3TC block compressed formats: BC1 (DXT1) for opaque
+// images and BC3 (DXT5) for images with alpha
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+// Bytes per 4x4 block
+const size_t BC1_BLOCK_BYTES = 8;
+const size_t BC3_BLOCK_BYTES = 16;
+
+// Size of one image compressed with blocks of blockBytes; partial blocks at the
+// right and bottom edges count as whole blocks
+size_t UBlockCompressedSize(int width, int height, size_t blockBytes);
+
+// Encode an RGBA8 image (tightly packed, 4 bytes per pixel) into out, which must
+// hold UBlockCompressedSize bytes. Edge blocks repeat the last row/column.
+void UEncodeBC1(const unsigned char* rgba, int width, int height, unsigned char* out);
+void UEncodeBC3(const unsigned char* rgba, int width, int height, unsigned char* out);
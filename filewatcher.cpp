@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+// filewatcher.cpp
+// ========
+// reports files that changed on disk: inotify on Linux, so an idle watcher
+// costs one non-blocking read per poll, and a throttled stat of every file
+// elsewhere. Directories are watched rather than files, so editors that save
+// by writing a new file and renaming it over the old one are still seen.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "filewatcher.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifndef __linux__
+	// Without change notifications every file is stat'ed at most this often
+	const std::chrono::milliseconds POLL_INTERVAL(250);
+#endif
+
+	void AddChanged(std::vector<std::string>& changed, const std::string& path)
+	{
+		if (std::find(changed.begin(), changed.end(), path) == changed.end())
+			changed.push_back(path);
+	}
+}
+
+FileWatcher::~FileWatcher()
+{
+	Stop();
+}
+
+bool FileWatcher::Watch(const std::string& path)
+{
+	if (files.count(path) != 0)
+		return true;
+
+#ifdef __linux__
+	if (inotify < 0)
+	{
+		inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify < 0)
+		{
+			std::cout << "ERROR::FILE_WATCHER::INOTIFY_UNAVAILABLE" << std::endl;
+			return false;
+		}
+	}
+
+	// Watching the same directory twice returns the same descriptor
+	const size_t separator = path.find_last_of('/');
+	const std::string directory = separator == std::string::npos ? std::string() : path.substr(0, separator + 1);
+	const int watch = inotify_add_watch(inotify, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (watch < 0)
+	{
+		std::cout << "ERROR::FILE_WATCHER::CANNOT_WATCH " << path << std::endl;
+		return false;
+	}
+	directories[watch] = directory;
+	files[path] = File();
+#else
+	struct stat info;
+	File file;
+	if (stat(path.c_str(), &info) == 0)
+	{
+		file.modified = static_cast<long long>(info.st_mtime);
+		file.size = static_cast<long long>(info.st_size);
+	}
+	files[path] = file;
+#endif
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Poll(std::vector<std::string>&)
+//
+//	changed: receives the paths; left as is if
+//	nothing changed
+//
+//	Never blocks. A save that takes several writes
+//	may be reported more than once.
+///////////////////////////////////////////////////
+void FileWatcher::Poll(std::vector<std::string>& changed)
+{
+#ifdef __linux__
+	if (inotify < 0)
+		return;
+
+	alignas(inotify_event) char buffer[4096];
+	for (;;)
+	{
+		const ssize_t length = read(inotify, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+
+		for (ssize_t offset = 0; offset < length; )
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			auto directory = directories.find(event->wd);
+			if (event->len == 0 || directory == directories.end())
+				continue;
+
+			const std::string path = directory->second + event->name;
+			if (files.count(path) != 0)
+				AddChanged(changed, path);
+		}
+	}
+#else
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - lastPoll < POLL_INTERVAL)
+		return;
+	lastPoll = now;
+
+	for (auto& entry : files)
+	{
+		struct stat info;
+		if (stat(entry.first.c_str(), &info) != 0)
+			continue;
+
+		File& file = entry.second;
+		const long long modified = static_cast<long long>(info.st_mtime);
+		const long long size = static_cast<long long>(info.st_size);
+		if (modified != file.modified || size != file.size)
+		{
+			file.modified = modified;
+			file.size = size;
+			AddChanged(changed, entry.first);
+		}
+	}
+#endif
+}
+
+void FileWatcher::Stop()
+{
+#ifdef __linux__
+	if (inotify >= 0)
+		close(inotify);
+	inotify = -1;
+	directories.clear();
+#endif
+	files.clear();
+}
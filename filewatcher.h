@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////////////
+// filewatcher.h
+// ========
+// reports files that changed on disk: inotify on Linux, so an idle watcher
+// costs one non-blocking read per poll, and a throttled stat of every file
+// elsewhere. Directories are watched rather than files, so editors that save
+// by writing a new file and renaming it over the old one are still seen.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class FileWatcher
+{
+public:
+	FileWatcher() = default;
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// Start watching path; paths already watched are ignored. False if the
+	// platform watcher cannot be set up, in which case nothing is reported.
+	bool Watch(const std::string& path);
+
+	// Appends every watched path written since the last call, each once
+	void Poll(std::vector<std::string>& changed);
+
+	// Stops watching everything
+	void Stop();
+
+private:
+	struct File
+	{
+		long long modified = -1;    // Polling fallback: last seen time and size
+		long long size = -1;
+	};
+
+	std::unordered_map<std::string, File> files;
+
+#ifdef __linux__
+	int inotify = -1;
+	std::unordered_map<int, std::string> directories;  // Watch descriptor -> directory, with its separator
+#else
+	std::chrono::steady_clock::time_point lastPoll;
+#endif
+};
@@ -0,0 +1,449 @@
+///////////////////////////////////////////////////////////////////////////////
+// imageops.cpp
+// ========
+// CPU resampling of tightly packed RGBA8 images, used to fit textures to their
+// layer size and to build their mip chains. Both filter in linear light from
+// sRGB input, with SSE/AVX2 inner loops.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "imageops.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "threadpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGEOPS_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define IMAGEOPS_USE_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Rows of a level handed to one thread at a time
+	const int MIP_BAND_ROWS = 32;
+
+	// Kaiser windowed sinc: taps sit at source offsets -3.5 .. 3.5 around each
+	// target texel center, with the window reaching 2 target texels out
+	const int KAISER_TAPS = 8;
+	const double KAISER_ALPHA = 4.0;
+	const double KAISER_RADIUS = 2.0;
+
+	// Linear to sRGB lookup resolution; fine enough to stay within half a
+	// code value of the exact curve near black, where it is steepest
+	const int LINEAR_TO_SRGB_ENTRIES = 16384;
+
+	// Modified Bessel function of the first kind, order 0 (power series)
+	double BesselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 32; k++)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	struct FilterTables
+	{
+		float toLinear[256];
+		unsigned char toSrgb[LINEAR_TO_SRGB_ENTRIES];
+		float kaiser[KAISER_TAPS];
+
+		FilterTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				const double value = i / 255.0;
+				toLinear[i] = float(value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4));
+			}
+
+			for (int i = 0; i < LINEAR_TO_SRGB_ENTRIES; i++)
+			{
+				const double value = double(i) / (LINEAR_TO_SRGB_ENTRIES - 1);
+				const double encoded = value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+				toSrgb[i] = (unsigned char)(encoded * 255.0 + 0.5);
+			}
+
+			const double pi = 3.14159265358979323846;
+			double total = 0.0;
+			double weights[KAISER_TAPS];
+			for (int i = 0; i < KAISER_TAPS; i++)
+			{
+				const double t = (i - (KAISER_TAPS - 1) * 0.5) * 0.5;    // target texels from the center
+				const double sinc = std::sin(pi * t) / (pi * t);
+				const double r = t / KAISER_RADIUS;
+				weights[i] = sinc * BesselI0(KAISER_ALPHA * std::sqrt(1.0 - r * r)) / BesselI0(KAISER_ALPHA);
+				total += weights[i];
+			}
+			for (int i = 0; i < KAISER_TAPS; i++)
+				kaiser[i] = float(weights[i] / total);
+		}
+	};
+
+	const FilterTables& Tables()
+	{
+		static const FilterTables tables;
+		return tables;
+	}
+
+	// One RGBA texel of linear floats
+#ifdef IMAGEOPS_USE_SSE
+	typedef __m128 Texel;
+	inline Texel LoadTexel(const float* p) { return _mm_loadu_ps(p); }
+	inline void StoreTexel(float* p, Texel texel) { _mm_storeu_ps(p, texel); }
+	inline Texel ZeroTexel() { return _mm_setzero_ps(); }
+	inline Texel MulAddTexel(Texel sum, Texel texel, float weight) { return _mm_add_ps(sum, _mm_mul_ps(texel, _mm_set1_ps(weight))); }
+#else
+	struct Texel { float v[4]; };
+	inline Texel LoadTexel(const float* p) { return Texel{ { p[0], p[1], p[2], p[3] } }; }
+	inline void StoreTexel(float* p, Texel texel) { memcpy(p, texel.v, sizeof(texel.v)); }
+	inline Texel ZeroTexel() { return Texel{ { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+	inline Texel MulAddTexel(Texel sum, Texel texel, float weight)
+	{
+		for (int channel = 0; channel < 4; channel++)
+			sum.v[channel] += texel.v[channel] * weight;
+		return sum;
+	}
+#endif
+
+	inline int Wrap(int value, int size)
+	{
+		value %= size;
+		return value < 0 ? value + size : value;
+	}
+
+	void SrgbToLinearRows(const unsigned char* rgba, int width, int firstRow, int lastRow, float* linear)
+	{
+		const float* toLinear = Tables().toLinear;
+		const size_t first = size_t(firstRow) * width * 4;
+		const size_t last = size_t(lastRow) * width * 4;
+		for (size_t i = first; i < last; i += 4)
+		{
+			linear[i + 0] = toLinear[rgba[i + 0]];
+			linear[i + 1] = toLinear[rgba[i + 1]];
+			linear[i + 2] = toLinear[rgba[i + 2]];
+			linear[i + 3] = rgba[i + 3] * (1.0f / 255.0f);
+		}
+	}
+
+	inline unsigned char EncodeSrgb(float value)
+	{
+		value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+		return Tables().toSrgb[int(value * (LINEAR_TO_SRGB_ENTRIES - 1) + 0.5f)];
+	}
+
+	inline unsigned char EncodeAlpha(float value)
+	{
+		value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+		return (unsigned char)(value * 255.0f + 0.5f);
+	}
+
+	void LinearToSrgbRows(const float* linear, int width, int firstRow, int lastRow, unsigned char* rgba)
+	{
+		const size_t first = size_t(firstRow) * width * 4;
+		const size_t last = size_t(lastRow) * width * 4;
+		for (size_t i = first; i < last; i += 4)
+		{
+			rgba[i + 0] = EncodeSrgb(linear[i + 0]);
+			rgba[i + 1] = EncodeSrgb(linear[i + 1]);
+			rgba[i + 2] = EncodeSrgb(linear[i + 2]);
+			rgba[i + 3] = EncodeAlpha(linear[i + 3]);
+		}
+	}
+
+	// 2x2 average of target rows [firstRow, lastRow); odd edges repeat the last
+	// row/column. An axis whose target is as large as the source is kept
+	// as is, so the other one can halve alone.
+	void BoxRows(const float* source, int width, int height, float* target, int targetWidth, int targetHeight, int firstRow, int lastRow)
+	{
+		const int stepX = targetWidth < width ? 2 : 1;
+		const int stepY = targetHeight < height ? 2 : 1;
+		for (int y = firstRow; y < lastRow; y++)
+		{
+			const int y0 = y * stepY < height ? y * stepY : height - 1;
+			const int y1 = y * stepY + stepY - 1 < height ? y * stepY + stepY - 1 : height - 1;
+			const float* row0 = source + size_t(y0) * width * 4;
+			const float* row1 = source + size_t(y1) * width * 4;
+			float* out = target + size_t(y) * targetWidth * 4;
+
+			int x = 0;
+#ifdef IMAGEOPS_USE_AVX2
+			// Two target texels per step; with an even width no column is repeated
+			if (stepX == 2 && (width & 1) == 0)
+			{
+				const __m256 quarter = _mm256_set1_ps(0.25f);
+				for (; x + 2 <= targetWidth; x += 2)
+				{
+					const __m256 a0 = _mm256_loadu_ps(row0 + x * 8);
+					const __m256 b0 = _mm256_loadu_ps(row0 + x * 8 + 8);
+					const __m256 a1 = _mm256_loadu_ps(row1 + x * 8);
+					const __m256 b1 = _mm256_loadu_ps(row1 + x * 8 + 8);
+					const __m256 top = _mm256_add_ps(_mm256_permute2f128_ps(a0, b0, 0x20), _mm256_permute2f128_ps(a0, b0, 0x31));
+					const __m256 bottom = _mm256_add_ps(_mm256_permute2f128_ps(a1, b1, 0x20), _mm256_permute2f128_ps(a1, b1, 0x31));
+					_mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(top, bottom), quarter));
+				}
+			}
+#endif
+			for (; x < targetWidth; x++)
+			{
+				const int x0 = x * stepX < width ? x * stepX : width - 1;
+				const int x1 = x * stepX + stepX - 1 < width ? x * stepX + stepX - 1 : width - 1;
+				Texel sum = ZeroTexel();
+				sum = MulAddTexel(sum, LoadTexel(row0 + x0 * 4), 0.25f);
+				sum = MulAddTexel(sum, LoadTexel(row0 + x1 * 4), 0.25f);
+				sum = MulAddTexel(sum, LoadTexel(row1 + x0 * 4), 0.25f);
+				sum = MulAddTexel(sum, LoadTexel(row1 + x1 * 4), 0.25f);
+				StoreTexel(out + x * 4, sum);
+			}
+		}
+	}
+
+	// Bilinear resample of target rows [firstRow, lastRow). Sample positions are
+	// pixel centers mapped between the two sizes, so edges line up in both
+	// directions; shrinking by 2:1 or more would skip source texels.
+	void BilinearRows(const float* source, int width, int height, float* target, int targetWidth, int targetHeight, int firstRow, int lastRow)
+	{
+		const float scaleX = float(width) / targetWidth;
+		const float scaleY = float(height) / targetHeight;
+
+		for (int y = firstRow; y < lastRow; y++)
+		{
+			float sourceY = (y + 0.5f) * scaleY - 0.5f;
+			sourceY = sourceY < 0.0f ? 0.0f : sourceY;
+			const int y0 = int(sourceY) < height - 1 ? int(sourceY) : height - 1;
+			const int y1 = y0 + 1 < height ? y0 + 1 : height - 1;
+			const float fractionY = sourceY - y0;
+			const float* row0 = source + size_t(y0) * width * 4;
+			const float* row1 = source + size_t(y1) * width * 4;
+			float* out = target + size_t(y) * targetWidth * 4;
+
+			for (int x = 0; x < targetWidth; x++)
+			{
+				float sourceX = (x + 0.5f) * scaleX - 0.5f;
+				sourceX = sourceX < 0.0f ? 0.0f : sourceX;
+				const int x0 = int(sourceX) < width - 1 ? int(sourceX) : width - 1;
+				const int x1 = x0 + 1 < width ? x0 + 1 : width - 1;
+				const float fractionX = sourceX - x0;
+
+				Texel sum = ZeroTexel();
+				sum = MulAddTexel(sum, LoadTexel(row0 + x0 * 4), (1.0f - fractionX) * (1.0f - fractionY));
+				sum = MulAddTexel(sum, LoadTexel(row0 + x1 * 4), fractionX * (1.0f - fractionY));
+				sum = MulAddTexel(sum, LoadTexel(row1 + x0 * 4), (1.0f - fractionX) * fractionY);
+				sum = MulAddTexel(sum, LoadTexel(row1 + x1 * 4), fractionX * fractionY);
+				StoreTexel(out + x * 4, sum);
+			}
+		}
+	}
+
+	// Kaiser pass along x for source rows [firstRow, lastRow): width -> targetWidth
+	void KaiserRowsX(const float* source, int width, float* target, int targetWidth, int firstRow, int lastRow)
+	{
+		const float* weights = Tables().kaiser;
+		for (int y = firstRow; y < lastRow; y++)
+		{
+			const float* row = source + size_t(y) * width * 4;
+			float* out = target + size_t(y) * targetWidth * 4;
+
+			for (int x = 0; x < targetWidth; x++)
+			{
+				const int base = x * 2 - (KAISER_TAPS / 2 - 1);
+				if (base < 0 || base + KAISER_TAPS + 2 > width)
+				{
+					// Edges wrap, matching GL_REPEAT sampling
+					Texel sum = ZeroTexel();
+					for (int i = 0; i < KAISER_TAPS; i++)
+						sum = MulAddTexel(sum, LoadTexel(row + Wrap(base + i, width) * 4), weights[i]);
+					StoreTexel(out + x * 4, sum);
+					continue;
+				}
+
+#ifdef IMAGEOPS_USE_AVX2
+				// Interior: texel x in the low half, x + 1 (taps two source texels on) in the high half
+				if (x + 1 < targetWidth)
+				{
+					__m256 sum = _mm256_setzero_ps();
+					for (int i = 0; i < KAISER_TAPS; i++)
+					{
+						const __m256 pair = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(row + (base + i) * 4)),
+							_mm_loadu_ps(row + (base + i + 2) * 4), 1);
+						sum = _mm256_add_ps(sum, _mm256_mul_ps(pair, _mm256_set1_ps(weights[i])));
+					}
+					_mm256_storeu_ps(out + x * 4, sum);
+					x++;
+					continue;
+				}
+#endif
+				Texel sum = ZeroTexel();
+				for (int i = 0; i < KAISER_TAPS; i++)
+					sum = MulAddTexel(sum, LoadTexel(row + (base + i) * 4), weights[i]);
+				StoreTexel(out + x * 4, sum);
+			}
+		}
+	}
+
+	// Kaiser pass along y for target rows [firstRow, lastRow): height -> target rows
+	void KaiserRowsY(const float* source, int width, int height, float* target, int firstRow, int lastRow)
+	{
+		const float* weights = Tables().kaiser;
+		for (int y = firstRow; y < lastRow; y++)
+		{
+			const float* rows[KAISER_TAPS];
+			const int base = y * 2 - (KAISER_TAPS / 2 - 1);
+			for (int i = 0; i < KAISER_TAPS; i++)
+				rows[i] = source + size_t(Wrap(base + i, height)) * width * 4;
+			float* out = target + size_t(y) * width * 4;
+
+			int x = 0;
+#ifdef IMAGEOPS_USE_AVX2
+			for (; x + 2 <= width; x += 2)
+			{
+				__m256 sum = _mm256_setzero_ps();
+				for (int i = 0; i < KAISER_TAPS; i++)
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[i] + x * 4), _mm256_set1_ps(weights[i])));
+				_mm256_storeu_ps(out + x * 4, sum);
+			}
+#endif
+			for (; x < width; x++)
+			{
+				Texel sum = ZeroTexel();
+				for (int i = 0; i < KAISER_TAPS; i++)
+					sum = MulAddTexel(sum, LoadTexel(rows[i] + x * 4), weights[i]);
+				StoreTexel(out + x * 4, sum);
+			}
+		}
+	}
+
+	// Split rows into bands and run body(firstRow, lastRow) on each
+	template <typename Body>
+	void RunBands(ThreadPool* pool, int rows, const Body& body)
+	{
+		const unsigned bands = unsigned((rows + MIP_BAND_ROWS - 1) / MIP_BAND_ROWS);
+		if (pool == nullptr || bands < 2)
+		{
+			body(0, rows);
+			return;
+		}
+
+		pool->ParallelFor(bands, [&](unsigned band) {
+			const int first = int(band) * MIP_BAND_ROWS;
+			body(first, first + MIP_BAND_ROWS < rows ? first + MIP_BAND_ROWS : rows);
+		});
+	}
+}
+
+///////////////////////////////////////////////////
+//	UResizeImage(const unsigned char*, int, int, int, int, ThreadPool*, std::vector<unsigned char>&)
+//
+//	The image goes to linear floats once and back to
+//	sRGB bytes once, however many box steps it takes
+//	to come within 2:1 of the target
+///////////////////////////////////////////////////
+void UResizeImage(const unsigned char* rgba, int width, int height, int targetWidth, int targetHeight, ThreadPool* pool, std::vector<unsigned char>& target)
+{
+	std::vector<float> current(size_t(width) * height * 4), next;
+	RunBands(pool, height, [&](int first, int last) {
+		SrgbToLinearRows(rgba, width, first, last, current.data());
+	});
+
+	while (width >= targetWidth * 2 || height >= targetHeight * 2)
+	{
+		const int halfWidth = width >= targetWidth * 2 ? width / 2 : width;
+		const int halfHeight = height >= targetHeight * 2 ? height / 2 : height;
+		next.resize(size_t(halfWidth) * halfHeight * 4);
+		RunBands(pool, halfHeight, [&](int first, int last) {
+			BoxRows(current.data(), width, height, next.data(), halfWidth, halfHeight, first, last);
+		});
+		current.swap(next);
+		width = halfWidth;
+		height = halfHeight;
+	}
+
+	target.resize(size_t(targetWidth) * targetHeight * 4);
+	if (width == targetWidth && height == targetHeight)
+	{
+		RunBands(pool, height, [&](int first, int last) {
+			LinearToSrgbRows(current.data(), width, first, last, target.data());
+		});
+		return;
+	}
+
+	next.resize(size_t(targetWidth) * targetHeight * 4);
+	RunBands(pool, targetHeight, [&](int first, int last) {
+		BilinearRows(current.data(), width, height, next.data(), targetWidth, targetHeight, first, last);
+		LinearToSrgbRows(next.data(), targetWidth, first, last, target.data());
+	});
+}
+
+size_t UMipChainSize(int width, int height)
+{
+	size_t size = 0;
+	for (;;)
+	{
+		size += size_t(width) * height * 4;
+		if (width == 1 && height == 1)
+			return size;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+}
+
+///////////////////////////////////////////////////
+//	UBuildMipChain(const unsigned char*, int, int, MipFilter, ThreadPool*, std::vector<unsigned char>&)
+//
+//	Every level is filtered from the linear float copy
+//	of the one above it, so rounding to 8 bits happens
+//	once per level rather than compounding down the
+//	chain. The Kaiser filter needs each axis to halve
+//	exactly; a level with an odd side uses the box.
+///////////////////////////////////////////////////
+void UBuildMipChain(const unsigned char* rgba, int width, int height, MipFilter filter, ThreadPool* pool, std::vector<unsigned char>& chain)
+{
+	chain.resize(UMipChainSize(width, height));
+	memcpy(chain.data(), rgba, size_t(width) * height * 4);
+
+	std::vector<float> current(size_t(width) * height * 4), next, columns;
+	RunBands(pool, height, [&](int first, int last) {
+		SrgbToLinearRows(rgba, width, first, last, current.data());
+	});
+
+	size_t offset = size_t(width) * height * 4;
+	while (width > 1 || height > 1)
+	{
+		const int targetWidth = width > 1 ? width / 2 : 1;
+		const int targetHeight = height > 1 ? height / 2 : 1;
+		unsigned char* level = chain.data() + offset;
+		next.resize(size_t(targetWidth) * targetHeight * 4);
+
+		const bool halves = (width == 1 || (width & 1) == 0) && (height == 1 || (height & 1) == 0);
+		if (filter == MIP_FILTER_KAISER && halves)
+		{
+			columns.resize(size_t(targetWidth) * height * 4);
+			RunBands(pool, height, [&](int first, int last) {
+				KaiserRowsX(current.data(), width, columns.data(), targetWidth, first, last);
+			});
+			RunBands(pool, targetHeight, [&](int first, int last) {
+				KaiserRowsY(columns.data(), targetWidth, height, next.data(), first, last);
+				LinearToSrgbRows(next.data(), targetWidth, first, last, level);
+			});
+		}
+		else
+		{
+			RunBands(pool, targetHeight, [&](int first, int last) {
+				BoxRows(current.data(), width, height, next.data(), targetWidth, targetHeight, first, last);
+				LinearToSrgbRows(next.data(), targetWidth, first, last, level);
+			});
+		}
+
+		current.swap(next);
+		width = targetWidth;
+		height = targetHeight;
+		offset += size_t(width) * height * 4;
+	}
+}
@@ -0,0 +1,36 @@
+///////////////////////////////////////////////////////////////////////////////
+// imageops.h
+// ========
+// CPU resampling of tightly packed RGBA8 images, used to fit textures to their
+// layer size and to build their mip chains. Both filter in linear light from
+// sRGB input, with SSE/AVX2 inner loops.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,     // 2x2 average; cheapest, slightly blurry and aliased
+	MIP_FILTER_KAISER   // 8 tap Kaiser windowed sinc per axis; sharper, wraps at the edges
+};
+
+// Resample an sRGB-encoded RGBA8 image to targetWidth x targetHeight into
+// target, color in linear light and alpha as stored: each side is halved
+// with a box filter while it is at least twice its target, then the rest is
+// bilinear. Rows are split into bands across pool and the calling thread;
+// pool may be null.
+void UResizeImage(const unsigned char* rgba, int width, int height, int targetWidth, int targetHeight, ThreadPool* pool, std::vector<unsigned char>& target);
+
+// Bytes of a full RGBA8 mip chain down to 1x1, largest level first
+size_t UMipChainSize(int width, int height);
+
+// Build the full mip chain of an sRGB-encoded RGBA8 image into chain (laid out
+// as UMipChainSize describes, level 0 being a copy of rgba). Color is
+// filtered in linear light and alpha as stored. Each level is split into row
+// bands across pool and the calling thread; pool may be null.
+void UBuildMipChain(const unsigned char* rgba, int width, int height, MipFilter filter, ThreadPool* pool, std::vector<unsigned char>& chain);
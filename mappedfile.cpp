@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.cpp
+// ========
+// read-only memory mapping of a whole file (POSIX mmap / Win32 file mapping)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "mappedfile.h"
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+///////////////////////////////////////////////////
+//	Open(const char*)
+//
+//	path: file to map
+//
+//	Map the whole file read-only; returns false if it
+//	cannot be opened or is empty
+///////////////////////////////////////////////////
+bool MappedFile::Open(const char* path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE mappingHandle = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL)
+	{
+		CloseHandle(mappingHandle);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file = handle;
+	mapping = mappingHandle;
+	data = static_cast<const unsigned char*>(view);
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	// the mapping keeps its own reference to the file
+	if (view == MAP_FAILED)
+		return false;
+
+	data = static_cast<const unsigned char*>(view);
+	size = static_cast<size_t>(info.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data == nullptr)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(static_cast<HANDLE>(mapping));
+	CloseHandle(static_cast<HANDLE>(file));
+	file = nullptr;
+	mapping = nullptr;
+#else
+	munmap(const_cast<unsigned char*>(data), size);
+#endif
+
+	data = nullptr;
+	size = 0;
+}
+
+long long UFileModifiedTime(const char* path)
+{
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return -1;
+	return static_cast<long long>(info.st_mtime);
+}
+
+bool UMakeDirectory(const char* path)
+{
+#ifdef _WIN32
+	if (_mkdir(path) == 0)
+		return true;
+#else
+	if (mkdir(path, 0755) == 0)
+		return true;
+#endif
+
+	struct stat info;
+	return stat(path, &info) == 0 && (info.st_mode & S_IFDIR) != 0;
+}
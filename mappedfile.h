@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.h
+// ========
+// read-only memory mapping of a whole file (POSIX mmap / Win32 file mapping)
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const char* path);
+	void Close();
+
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* file = nullptr;       // HANDLE of the open file
+	void* mapping = nullptr;    // HANDLE of the file mapping object
+#endif
+};
+
+// Modification time of a file in seconds, or -1 if it does not exist
+long long UFileModifiedTime(const char* path);
+
+// Create a single directory; true if it exists afterwards
+bool UMakeDirectory(const char* path);
@@ -13,15 +13,67 @@
 
 #include <glm/glm.hpp>
 
+#include <vector>
+
+// Identifies one of the primitive meshes, e.g. from a scene file
+enum MeshType
+{
+	MESH_BOX,
+	MESH_CONE,
+	MESH_CYLINDER,
+	MESH_TAPERED_CYLINDER,
+	MESH_PLANE,
+	MESH_PRISM,
+	MESH_SPHERE,
+	MESH_PYRAMID3,
+	MESH_PYRAMID4,
+	MESH_TORUS,
+	MESH_COUNT
+};
+
+// Per-instance vertex attributes, one entry per drawn copy of a mesh
+struct MeshInstance
+{
+	glm::mat4 model;            // locations 3-6
+	glm::vec4 normalMatrix[3];  // locations 7-9 (mat3 columns, padded to vec4)
+	glm::vec4 tint;             // location 10
+	GLuint material;            // location 11, texture array layer or bindless handle index
+};
+
+// Most levels of detail a mesh can have; level 0 is the finest
+const GLuint MESH_LOD_COUNT = 4;
+
+// Layout GL expects for each entry of a GL_DRAW_INDIRECT_BUFFER read by
+// glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
 class Meshes
 {
-	// Stores the GL data relative to a given mesh
+	// Stores where one level of detail lives in the shared vertex/index buffers
+	struct GLMeshLod
+	{
+		GLint baseVertex;   // First vertex of the level in the shared vertex buffer
+		GLuint firstIndex;  // First index of the level in the shared index buffer
+		GLuint nVertices;	// Number of vertices for the level
+		GLuint nIndices;    // Number of indices for the level
+		GLfloat error;      // Largest distance from the true surface, in model units
+	};
+
+	// Stores the GL data relative to a given mesh: a chain of levels of detail,
+	// finest first, stored one after another in the shared buffers
 	struct GLMesh
 	{
-		GLuint vao;         // Handle for the vertex array object
-		GLuint vbos[2];     // Handles for the vertex buffer objects
-		GLuint nVertices;	// Number of vertices for the mesh
-		GLuint nIndices;    // Number of indices for the mesh
+		GLMeshLod lods[MESH_LOD_COUNT];
+		GLuint nLods;       // Number of valid entries in lods
+		glm::vec3 center;   // Bounding sphere in model space
+		GLfloat radius;
 	};
 
 public:
@@ -40,6 +92,29 @@ public:
 	void CreateMeshes();
 	void DestroyMeshes();
 
+	GLMesh& GetMesh(MeshType type);
+
+	// Binds the VAO shared by every mesh; DrawMesh expects it to be bound
+	void BindMeshes();
+	void DrawMesh(MeshType type, GLuint instanceCount = 1, GLuint baseInstance = 0, GLuint lod = 0);
+
+	// Indirect draw command equivalent to DrawMesh(type, instanceCount, baseInstance, lod)
+	DrawElementsIndirectCommand GetDrawCommand(MeshType type, GLuint lod, GLuint instanceCount, GLuint baseInstance);
+
+	// Model space bounding sphere of the finest level
+	glm::vec3 GetBoundsCenter(MeshType type) { return GetMesh(type).center; }
+	GLfloat GetBoundsRadius(MeshType type) { return GetMesh(type).radius; }
+
+	// Picks the coarsest level whose error stays under maxPixelError once
+	// projected; pixelsPerUnit is the screen size of one model space unit
+	GLuint SelectLod(MeshType type, GLfloat pixelsPerUnit, GLfloat maxPixelError = 1.0f);
+
+	// Submits drawCount commands from the bound GL_DRAW_INDIRECT_BUFFER in one call
+	void DrawMeshesIndirect(GLuint firstCommand, GLsizei drawCount);
+
+	// Sources attributes 3-11 of the shared VAO from a buffer of MeshInstance
+	void AttachInstanceBuffer(GLuint instanceVbo);
+
 private:
 	void UCreatePlaneMesh(GLMesh &mesh);
 	void UCreatePrismMesh(GLMesh &mesh);
@@ -47,12 +122,30 @@ private:
 	void UCreateConeMesh(GLMesh &mesh);
 	void UCreateCylinderMesh(GLMesh &mesh);
 	void UCreateTaperedCylinderMesh(GLMesh &mesh);
+	void UCreateFrustumMesh(GLMesh &mesh, GLfloat bottomRadius, GLfloat topRadius);
+	void UCreateFrustumLod(GLMeshLod &lod, GLuint segments, GLfloat bottomRadius, GLfloat topRadius);
 	void UCreateTorusMesh(GLMesh &mesh);
+	void UCreateTorusLod(GLMeshLod &lod, GLuint mainSegments, GLuint tubeSegments);
 	void UCreatePyramid3Mesh(GLMesh &mesh);
 	void UCreatePyramid4Mesh(GLMesh &mesh);
 	void UCreateSphereMesh(GLMesh &mesh);
+	void UCreateSphereLod(GLMeshLod &lod, GLuint sectors, GLuint stacks);
 
-	void UDestroyMesh(GLMesh &mesh);
+	void UAppendMesh(GLMesh &mesh, const GLfloat* verts, GLuint nVertices, const GLuint* indices, GLuint nIndices);
+	void UReserveMesh(GLMeshLod &lod, GLuint nVertices, GLuint nIndices, GLfloat*& vertexOut, GLuint*& indexOut);
+	void UComputeBounds(GLMesh &mesh);
+	const glm::vec2* UCircleTable(GLuint slot, GLuint segments);
+	void UUploadMeshes();
 
 	void CalculateTriangleNormal(glm::vec3 px, glm::vec3 py, glm::vec3 pz);
+
+	GLuint vao = 0;         // Handle for the vertex array object shared by every mesh
+	GLuint vbos[2] = {};    // Handles for the shared vertex and index buffers
+
+	// Interleaved vertices and indices collected by CreateMeshes before upload
+	std::vector<GLfloat> stagingVertices;
+	std::vector<GLuint> stagingIndices;
+
+	// Cached sin/cos tables reused by the generators
+	std::vector<glm::vec2> circleTables[2];
 };
\ No newline at end of file
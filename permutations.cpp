@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+// permutations.cpp
+// ========
+// variants of the scene shader specialized at compile time for what each
+// material needs: every feature a material leaves out, and every point
+// light the scene does not have, is #ifdef'd out of its fragment shader
+// instead of being evaluated per pixel. Variants are built the first time
+// a material asks for one and live in the shader manager from then on.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "permutations.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Define for each MaterialFeature bit, lowest first
+	const char* const FEATURE_DEFINES[] = {
+		"MATERIAL_TEXTURED",
+		"MATERIAL_SPECULAR",
+		"MATERIAL_KEY_LIGHT",
+		"MATERIAL_ALPHA"
+	};
+}
+
+PermutationKey UPermutationKey(GLuint features, GLuint pointLights)
+{
+	return std::min(pointLights, MAX_POINT_LIGHTS) | (features << 4);
+}
+
+void UPermutationDefines(PermutationKey key, std::vector<std::string>& defines)
+{
+	const GLuint features = UPermutationFeatures(key);
+	for (GLuint i = 0; i < sizeof(FEATURE_DEFINES) / sizeof(FEATURE_DEFINES[0]); i++)
+	{
+		if (features & (1u << i))
+			defines.push_back(FEATURE_DEFINES[i]);
+	}
+	defines.push_back("POINT_LIGHT_COUNT " + std::to_string(UPermutationPointLights(key)));
+}
+
+void ShaderPermutations::Start(ShaderManager* shaders, const ProgramDesc& base)
+{
+	this->shaders = shaders;
+	this->base = base;
+	handles.clear();
+}
+
+GLuint ShaderPermutations::Request(PermutationKey key)
+{
+	auto found = handles.find(key);
+	if (found != handles.end())
+		return found->second;
+
+	ProgramDesc desc = base;
+	UPermutationDefines(key, desc.defines);
+	const GLuint handle = shaders->Submit(desc);
+	handles.emplace(key, handle);
+	return handle;
+}
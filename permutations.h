@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////////
+// permutations.h
+// ========
+// variants of the scene shader specialized at compile time for what each
+// material needs: every feature a material leaves out, and every point
+// light the scene does not have, is #ifdef'd out of its fragment shader
+// instead of being evaluated per pixel. Variants are built the first time
+// a material asks for one and live in the shader manager from then on.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shadermanager.h"
+
+// What a material's shading includes; each is a MATERIAL_* define in the shader
+enum MaterialFeature
+{
+	MATERIAL_TEXTURED = 1 << 0,     // Texture fetch, else the tint alone
+	MATERIAL_SPECULAR = 1 << 1,     // Specular highlights from every light
+	MATERIAL_KEY_LIGHT = 1 << 2,    // Diffuse (and specular) from the key light
+	MATERIAL_ALPHA = 1 << 3         // Blended with the texture and tint alpha
+};
+
+const GLuint MATERIAL_DEFAULT_FEATURES = MATERIAL_TEXTURED | MATERIAL_SPECULAR | MATERIAL_KEY_LIGHT;
+
+// Point lights the frame uniforms have room for; a variant loops over a fixed number of them
+const GLuint MAX_POINT_LIGHTS = 4;
+
+// One variant: the point light count in the low bits, the features above.
+// MATERIAL_ALPHA is the highest bit, so ascending keys draw every opaque
+// variant before the blended ones.
+typedef GLuint PermutationKey;
+
+PermutationKey UPermutationKey(GLuint features, GLuint pointLights);
+
+inline GLuint UPermutationFeatures(PermutationKey key) { return key >> 4; }
+inline GLuint UPermutationPointLights(PermutationKey key) { return key & 0xF; }
+
+// Defines that specialize the scene shader for key, e.g. MATERIAL_TEXTURED, POINT_LIGHT_COUNT 2
+void UPermutationDefines(PermutationKey key, std::vector<std::string>& defines);
+
+class ShaderPermutations
+{
+public:
+	// base: the sources and the defines every variant shares
+	void Start(ShaderManager* shaders, const ProgramDesc& base);
+
+	// Handle in the shader manager of key's variant, submitted the first time
+	// it is asked for; the manager and the program cache hold it from then on
+	GLuint Request(PermutationKey key);
+
+	GLuint Count() const { return GLuint(handles.size()); }
+
+private:
+	ShaderManager* shaders = nullptr;
+	ProgramDesc base;
+	std::unordered_map<PermutationKey, GLuint> handles;
+};
@@ -0,0 +1,196 @@
+///////////////////////////////////////////////////////////////////////////////
+// programcache.cpp
+// ========
+// on-disk cache of linked GL programs: the binary from glGetProgramBinary is
+// stored under a hash of the program's sources and the driver's vendor,
+// renderer and version strings, and handed back to glProgramBinary on later
+// runs so warm starts skip GLSL compilation entirely
+///////////////////////////////////////////////////////////////////////////////
+
+#include "programcache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+namespace
+{
+	// Bump whenever the file layout changes
+	const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+	const uint32_t PROGRAM_MAGIC = 0x42504C47;  // "GLPB"
+
+	struct ProgramHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t binaryFormat;  // As glGetProgramBinary reported it
+		uint32_t length;        // Bytes of binary following the header
+	};
+
+	unsigned long long HashBytes(unsigned long long hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Strings are hashed with their terminator, so moving text between two
+	// adjacent ones changes the key
+	unsigned long long HashString(unsigned long long hash, const char* text)
+	{
+		return HashBytes(hash, text, strlen(text) + 1);
+	}
+
+	std::string BinaryPath(unsigned long long key)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", key);
+		return std::string(PROGRAM_CACHE_DIRECTORY) + "/" + name;
+	}
+
+	// Some drivers expose the entry points but no binary format at all
+	bool BinariesSupported()
+	{
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+}
+
+unsigned long long UProgramCacheKey(std::initializer_list<const char*> sources)
+{
+	unsigned long long hash = HashBytes(14695981039346656037ull, &PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+
+	// A driver update may change what it accepts, so it is part of the key
+	const GLenum driverStrings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (GLenum name : driverStrings)
+	{
+		const GLubyte* value = glGetString(name);
+		hash = HashString(hash, value != nullptr ? reinterpret_cast<const char*>(value) : "");
+	}
+
+	for (const char* source : sources)
+		hash = HashString(hash, source != nullptr ? source : "");
+	return hash;
+}
+
+///////////////////////////////////////////////////
+//	ULoadProgramBinary(unsigned long long, GLuint&)
+//
+//	key: from UProgramCacheKey
+//	programId: receives the linked program
+///////////////////////////////////////////////////
+bool ULoadProgramBinary(unsigned long long key, GLuint& programId)
+{
+	if (!BinariesSupported())
+		return false;
+
+	const std::string path = BinaryPath(key);
+	MappedFile file;
+	if (!file.Open(path.c_str()))
+		return false;
+
+	ProgramHeader header;
+	if (file.Size() < sizeof(header))
+		return false;
+	memcpy(&header, file.Data(), sizeof(header));
+	if (header.magic != PROGRAM_MAGIC || header.version != PROGRAM_CACHE_VERSION ||
+		file.Size() != sizeof(header) + header.length)
+	{
+		std::cout << "ERROR::PROGRAM_CACHE::BAD_HEADER " << path << std::endl;
+		return false;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, GLenum(header.binaryFormat), file.Data() + sizeof(header), GLsizei(header.length));
+
+	// The driver may still refuse a binary it wrote, e.g. after a setting changed
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glDeleteProgram(program);
+		return false;
+	}
+
+	programId = program;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	USaveProgramBinary(unsigned long long, GLuint)
+//
+//	key: from UProgramCacheKey
+//	programId: successfully linked program
+//
+//	Writes to a temporary name and renames it into
+//	place, so a reader never sees a half written file
+///////////////////////////////////////////////////
+bool USaveProgramBinary(unsigned long long key, GLuint programId)
+{
+	if (!BinariesSupported())
+		return false;
+
+	GLint length = 0;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+
+	std::vector<unsigned char> binary(static_cast<size_t>(length));
+	GLenum binaryFormat = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(programId, length, &written, &binaryFormat, binary.data());
+	if (written <= 0)
+		return false;
+
+	ProgramHeader header;
+	header.magic = PROGRAM_MAGIC;
+	header.version = PROGRAM_CACHE_VERSION;
+	header.binaryFormat = uint32_t(binaryFormat);
+	header.length = uint32_t(written);
+
+	UMakeDirectory(PROGRAM_CACHE_DIRECTORY);
+
+	const std::string path = BinaryPath(key);
+	static std::atomic<unsigned> nTemporaries{ 0 };
+	const std::string temporaryPath = path + "." + std::to_string(nTemporaries++) + ".tmp";
+
+	{
+		std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!output.is_open())
+		{
+			std::cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE " << temporaryPath << std::endl;
+			return false;
+		}
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		output.write(reinterpret_cast<const char*>(binary.data()), written);
+		if (!output)
+		{
+			std::cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE " << temporaryPath << std::endl;
+			output.close();
+			std::remove(temporaryPath.c_str());
+			return false;
+		}
+	}
+
+	// Win32 will not rename over an existing file, e.g. one the driver refused
+	std::remove(path.c_str());
+	if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporaryPath.c_str());
+		return false;
+	}
+	return true;
+}
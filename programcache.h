@@ -0,0 +1,30 @@
+///////////////////////////////////////////////////////////////////////////////
+// programcache.h
+// ========
+// on-disk cache of linked GL programs: the binary from glGetProgramBinary is
+// stored under a hash of the program's sources and the driver's vendor,
+// renderer and version strings, and handed back to glProgramBinary on later
+// runs so warm starts skip GLSL compilation entirely
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <initializer_list>
+
+// Directory the binaries are written to, relative to the working directory
+const char* const PROGRAM_CACHE_DIRECTORY = "ProgramCache";
+
+// Key for a program built from sources (every stage, in a fixed order; null
+// entries are skipped) by the driver behind the current context
+unsigned long long UProgramCacheKey(std::initializer_list<const char*> sources);
+
+// Create programId from the binary cached under key. False, with nothing
+// created, if there is none or the driver refuses it; the caller then
+// compiles from source and stores the result with USaveProgramBinary.
+bool ULoadProgramBinary(unsigned long long key, GLuint& programId);
+
+// Store a linked program's binary under key; a partial file is never left.
+// The program should have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+bool USaveProgramBinary(unsigned long long key, GLuint programId);
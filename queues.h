@@ -0,0 +1,217 @@
+///////////////////////////////////////////////////////////////////////////////
+// queues.h
+// ========
+// lock-free queues for handing work, events and state between threads
+// without blocking the render loop
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded multi-producer multi-consumer queue (Vyukov's sequence-numbered
+// ring). Every cell carries a sequence number that tells producers and
+// consumers whose turn it is, so neither side ever takes a lock. T must be
+// default constructible and movable.
+template <typename T>
+class BoundedQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit BoundedQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+
+		mask = size - 1;
+		cells.reset(new Cell[size]);
+		for (size_t i = 0; i < size; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	// Returns false if the queue is full
+	bool TryPush(T value)
+	{
+		size_t position = tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & mask];
+			const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const ptrdiff_t difference = ptrdiff_t(sequence) - ptrdiff_t(position);
+
+			if (difference == 0)
+			{
+				if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					cell.value = std::move(value);
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+				return false;
+			else
+				position = tail.load(std::memory_order_relaxed);
+		}
+	}
+
+	// Returns false if the queue is empty
+	bool TryPop(T& value)
+	{
+		size_t position = head.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & mask];
+			const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const ptrdiff_t difference = ptrdiff_t(sequence) - ptrdiff_t(position + 1);
+
+			if (difference == 0)
+			{
+				if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					value = std::move(cell.value);
+					cell.sequence.store(position + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+				return false;
+			else
+				position = head.load(std::memory_order_relaxed);
+		}
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask = 0;
+
+	// Kept on separate cache lines so producers and consumers do not contend
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	alignas(64) std::atomic<size_t> head{ 0 };
+};
+
+// Bounded single-producer single-consumer ring. With one thread on each end
+// no compare-exchange is needed: each side owns its index and publishes it
+// with one release store, and keeps a copy of the other side's index so it
+// only reads the shared one when the ring looks full or empty. Cheap enough
+// for every event of a high-rate mouse. T must be default constructible and
+// copy assignable.
+template <typename T>
+class SpscQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit SpscQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+
+		mask = size - 1;
+		values.reset(new T[size]);
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	// Producer only; returns false if the queue is full
+	bool TryPush(const T& value)
+	{
+		const size_t position = tail.load(std::memory_order_relaxed);
+		if (position - cachedHead > mask)
+		{
+			cachedHead = head.load(std::memory_order_acquire);
+			if (position - cachedHead > mask)
+				return false;
+		}
+
+		values[position & mask] = value;
+		tail.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only; returns false if the queue is empty
+	bool TryPop(T& value)
+	{
+		const size_t position = head.load(std::memory_order_relaxed);
+		if (position == cachedTail)
+		{
+			cachedTail = tail.load(std::memory_order_acquire);
+			if (position == cachedTail)
+				return false;
+		}
+
+		value = values[position & mask];
+		head.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::unique_ptr<T[]> values;
+	size_t mask = 0;
+
+	// Each side's index and its copy of the other's on their own cache line
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	size_t cachedHead = 0;      // Producer only
+	alignas(64) std::atomic<size_t> head{ 0 };
+	size_t cachedTail = 0;      // Consumer only
+};
+
+// Latest-value handoff from one writer thread to one reader thread. Of the
+// three copies of T the writer always owns one to fill and the reader one to
+// read, and the third sits between them; publishing and picking up are each
+// a single atomic exchange, so neither side ever waits on the other. Values
+// the reader has not picked up yet are replaced by newer ones. T must be
+// copy assignable.
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() = default;
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// Writer only: publishes value in place of any the reader has not taken
+	void Write(const T& value)
+	{
+		buffers[back] = value;
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// Reader only: copies out the newest value published since the last
+	// call; false, with value untouched, if there is none
+	bool Read(T& value)
+	{
+		if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+			return false;
+
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+		value = buffers[front];
+		return true;
+	}
+
+private:
+	// middle holds a buffer index, with FRESH set while the reader has not taken it
+	static const unsigned INDEX_MASK = 3;
+	static const unsigned FRESH = 4;
+
+	T buffers[3];
+
+	// Each side's index on its own cache line, away from the shared one
+	alignas(64) std::atomic<unsigned> middle{ 1 };
+	alignas(64) unsigned back = 0;      // Writer only
+	alignas(64) unsigned front = 2;     // Reader only
+};
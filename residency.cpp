@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+// residency.cpp
+// ========
+// keeps bindless texture handles resident within a memory budget: handles
+// used by the current frame are made resident, and the least recently used
+// ones are made non-resident once the budget is exceeded
+///////////////////////////////////////////////////////////////////////////////
+
+#include "residency.h"
+
+#include <algorithm>
+
+GLuint ResidencyManager::Add(GLuint64 handle, GLuint64 bytes)
+{
+	entries.push_back(Entry{ handle, bytes, 0, false });
+	return GLuint(entries.size() - 1);
+}
+
+bool ResidencyManager::Replace(GLuint slot, GLuint64 handle, GLuint64 bytes)
+{
+	Entry& entry = entries[slot];
+	if (entry.resident)
+	{
+		glMakeTextureHandleResidentARB(handle);
+		residentBytes = residentBytes - entry.bytes + bytes;
+	}
+	entry.handle = handle;
+	entry.bytes = bytes;
+	return entry.resident;
+}
+
+///////////////////////////////////////////////////
+//	Update()
+//
+//	Residency calls are cheap but not free, so only
+//	handles whose state actually changes are touched
+///////////////////////////////////////////////////
+void ResidencyManager::Update()
+{
+	for (Entry& entry : entries)
+	{
+		if (entry.lastUsed == frame && !entry.resident)
+		{
+			glMakeTextureHandleResidentARB(entry.handle);
+			entry.resident = true;
+			residentBytes += entry.bytes;
+		}
+	}
+
+	if (residentBytes > budget)
+	{
+		evictable.clear();
+		for (GLuint slot = 0; slot < GLuint(entries.size()); slot++)
+		{
+			if (entries[slot].resident && entries[slot].lastUsed != frame)
+				evictable.push_back(slot);
+		}
+		std::sort(evictable.begin(), evictable.end(), [this](GLuint a, GLuint b) {
+			return entries[a].lastUsed < entries[b].lastUsed;
+		});
+
+		for (GLuint slot : evictable)
+		{
+			if (residentBytes <= budget)
+				break;
+			glMakeTextureHandleNonResidentARB(entries[slot].handle);
+			entries[slot].resident = false;
+			residentBytes -= entries[slot].bytes;
+		}
+	}
+
+	frame++;
+}
+
+void ResidencyManager::Clear()
+{
+	for (Entry& entry : entries)
+	{
+		if (entry.resident)
+			glMakeTextureHandleNonResidentARB(entry.handle);
+	}
+	entries.clear();
+	residentBytes = 0;
+}
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// residency.h
+// ========
+// keeps bindless texture handles resident within a memory budget: handles
+// used by the current frame are made resident, and the least recently used
+// ones are made non-resident once the budget is exceeded
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// Budget used until SetBudget is called
+const GLuint64 DEFAULT_RESIDENCY_BUDGET = 256ull * 1024 * 1024;
+
+class ResidencyManager
+{
+public:
+	// Tracks a handle from glGetTextureHandleARB and the bytes its texture
+	// occupies; returns the slot Use takes. The handle starts non-resident.
+	GLuint Add(GLuint64 handle, GLuint64 bytes);
+
+	// Points a slot at the handle of a texture that replaced its old one, e.g.
+	// after a resize. A resident slot stays resident with the new handle. The
+	// old handle is left as it is, since draws still in flight may sample it;
+	// returns whether it is resident, for the caller to make non-resident
+	// once they are done and before deleting its texture.
+	bool Replace(GLuint slot, GLuint64 handle, GLuint64 bytes);
+
+	// Marks a slot as needed by the frame being built
+	void Use(GLuint slot) { entries[slot].lastUsed = frame; }
+
+	// Call once per frame before drawing: makes every handle used this frame
+	// resident, then evicts the least recently used unused ones until the
+	// total fits the budget. Handles in use are never evicted, so a frame
+	// that needs more than the budget goes over it rather than failing.
+	void Update();
+
+	// Makes every handle non-resident and forgets them
+	void Clear();
+
+	void SetBudget(GLuint64 bytes) { budget = bytes; }
+	GLuint64 Budget() const { return budget; }
+	GLuint64 ResidentBytes() const { return residentBytes; }
+
+private:
+	struct Entry
+	{
+		GLuint64 handle;
+		GLuint64 bytes;
+		GLuint64 lastUsed;      // Frame number, 0 if never used
+		bool resident;
+	};
+
+	std::vector<Entry> entries;
+	std::vector<GLuint> evictable;  // Scratch for Update, kept to avoid reallocating
+	GLuint64 budget = DEFAULT_RESIDENCY_BUDGET;
+	GLuint64 residentBytes = 0;
+	GLuint64 frame = 1;
+};
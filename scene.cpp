@@ -0,0 +1,334 @@
+///////////////////////////////////////////////////////////////////////////////
+// scene.cpp
+// ========
+// data-driven scene description: which mesh, texture, transform and material
+// features each object uses, and the point lights. Scenes are authored as
+// text and compiled to a binary file of fixed-size records that is
+// memory-mapped on load.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scene.h"
+#include "mappedfile.h"
+#include "permutations.h"
+
+#include <glm/gtx/transform.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	// Names used for meshes in scene files, indexed by MeshType
+	const char* const MESH_NAMES[MESH_COUNT] = {
+		"box",
+		"cone",
+		"cylinder",
+		"tapered_cylinder",
+		"plane",
+		"prism",
+		"sphere",
+		"pyramid3",
+		"pyramid4",
+		"torus"
+	};
+
+	// Words after an object's tint, each switching one MaterialFeature
+	struct FeatureWord
+	{
+		const char* word;
+		GLuint feature;
+		bool enable;
+	};
+	const FeatureWord FEATURE_WORDS[] = {
+		{ "notexture", MATERIAL_TEXTURED, false },
+		{ "nospecular", MATERIAL_SPECULAR, false },
+		{ "nokey", MATERIAL_KEY_LIGHT, false },
+		{ "alpha", MATERIAL_ALPHA, true }
+	};
+
+	bool ParseFeature(const std::string& word, GLuint& features)
+	{
+		for (const FeatureWord& entry : FEATURE_WORDS)
+		{
+			if (word == entry.word)
+			{
+				features = entry.enable ? features | entry.feature : features & ~entry.feature;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseMeshType(const std::string& name, GLuint& type)
+	{
+		for (GLuint i = 0; i < MESH_COUNT; i++)
+		{
+			if (name == MESH_NAMES[i])
+			{
+				type = i;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Load(const char*)
+//
+//	path: text scene file (the binary lives next to it
+//	with a trailing 'b', e.g. desk.scene -> desk.sceneb)
+//
+//	Compile the text if its binary is stale, then map
+//	the binary and copy it into the flat arrays
+///////////////////////////////////////////////////
+bool Scene::Load(const char* path)
+{
+	std::string binaryPath = std::string(path) + "b";
+
+	long long textTime = UFileModifiedTime(path);
+	long long binaryTime = UFileModifiedTime(binaryPath.c_str());
+	if (textTime >= 0 && binaryTime < textTime)
+	{
+		if (!Compile(path, binaryPath.c_str()))
+			return false;
+	}
+
+	if (LoadBinary(binaryPath.c_str()))
+		return true;
+
+	// The binary may have been written by an older version; rebuild it once
+	if (textTime < 0 || !Compile(path, binaryPath.c_str()))
+		return false;
+	return LoadBinary(binaryPath.c_str());
+}
+
+///////////////////////////////////////////////////
+//	Compile(const char*, const char*)
+//
+//	Text format, one entry per line ('#' starts a comment):
+//
+//	texture <name> <path>
+//	light <x y z> <r g b>
+//	object <mesh> <texture name> <tx ty tz> <axis x y z> <angle> <sx sy sz> [r g b a] [features]
+//
+//	features: any of notexture, nospecular, nokey and
+//	alpha, each picking a cheaper or blended shader
+///////////////////////////////////////////////////
+bool Scene::Compile(const char* textPath, const char* binaryPath)
+{
+	std::ifstream input(textPath);
+	if (!input.is_open())
+	{
+		std::cout << "ERROR::SCENE::CANNOT_OPEN " << textPath << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> textureNames;
+	std::vector<SceneTextureRecord> textures;
+	std::vector<SceneLightRecord> lights;
+	std::vector<SceneObjectRecord> objects;
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(input, line))
+	{
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.resize(comment);
+
+		std::istringstream tokens(line);
+		std::string keyword;
+		if (!(tokens >> keyword))
+			continue;
+
+		if (keyword == "texture")
+		{
+			std::string name, texturePath;
+			if (!(tokens >> name >> texturePath) || texturePath.size() >= SCENE_PATH_LENGTH)
+			{
+				std::cout << "ERROR::SCENE::BAD_TEXTURE " << textPath << ":" << lineNumber << std::endl;
+				return false;
+			}
+
+			SceneTextureRecord record = {};
+			strncpy(record.path, texturePath.c_str(), SCENE_PATH_LENGTH - 1);
+			textureNames.push_back(name);
+			textures.push_back(record);
+		}
+		else if (keyword == "light")
+		{
+			SceneLightRecord record = {};
+			if (!(tokens >> record.position[0] >> record.position[1] >> record.position[2]
+				>> record.color[0] >> record.color[1] >> record.color[2]))
+			{
+				std::cout << "ERROR::SCENE::BAD_LIGHT " << textPath << ":" << lineNumber << std::endl;
+				return false;
+			}
+			lights.push_back(record);
+		}
+		else if (keyword == "object")
+		{
+			std::string meshName, textureName;
+			SceneObjectRecord record = {};
+			tokens >> meshName >> textureName
+				>> record.translation[0] >> record.translation[1] >> record.translation[2]
+				>> record.axis[0] >> record.axis[1] >> record.axis[2] >> record.angle
+				>> record.scale[0] >> record.scale[1] >> record.scale[2];
+			if (tokens.fail() || !ParseMeshType(meshName, record.mesh))
+			{
+				std::cout << "ERROR::SCENE::BAD_OBJECT " << textPath << ":" << lineNumber << std::endl;
+				return false;
+			}
+
+			// Optional tint, told apart from the feature words by its leading digit
+			record.tint[0] = record.tint[1] = record.tint[2] = record.tint[3] = 1.0f;
+			tokens >> std::ws;
+			const int next = tokens.peek();
+			if ((next >= '0' && next <= '9') || next == '.' || next == '-')
+			{
+				if (!(tokens >> record.tint[0] >> record.tint[1] >> record.tint[2] >> record.tint[3]))
+				{
+					std::cout << "ERROR::SCENE::BAD_OBJECT " << textPath << ":" << lineNumber << std::endl;
+					return false;
+				}
+			}
+
+			record.features = MATERIAL_DEFAULT_FEATURES;
+			std::string feature;
+			while (tokens >> feature)
+			{
+				if (!ParseFeature(feature, record.features))
+				{
+					std::cout << "ERROR::SCENE::UNKNOWN_FEATURE " << feature << " at " << textPath << ":" << lineNumber << std::endl;
+					return false;
+				}
+			}
+
+			record.texture = GLuint(textureNames.size());
+			for (GLuint i = 0; i < textureNames.size(); i++)
+			{
+				if (textureNames[i] == textureName)
+					record.texture = i;
+			}
+			if (record.texture == textureNames.size())
+			{
+				std::cout << "ERROR::SCENE::UNKNOWN_TEXTURE " << textureName << " at " << textPath << ":" << lineNumber << std::endl;
+				return false;
+			}
+
+			objects.push_back(record);
+		}
+		else
+		{
+			std::cout << "ERROR::SCENE::UNKNOWN_KEYWORD " << keyword << " at " << textPath << ":" << lineNumber << std::endl;
+			return false;
+		}
+	}
+
+	SceneFileHeader header;
+	memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_FILE_VERSION;
+	header.textureCount = GLuint(textures.size());
+	header.lightCount = GLuint(lights.size());
+	header.objectCount = GLuint(objects.size());
+
+	std::ofstream output(binaryPath, std::ios::binary | std::ios::trunc);
+	if (!output.is_open())
+	{
+		std::cout << "ERROR::SCENE::CANNOT_WRITE " << binaryPath << std::endl;
+		return false;
+	}
+
+	output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	output.write(reinterpret_cast<const char*>(textures.data()), sizeof(SceneTextureRecord) * textures.size());
+	output.write(reinterpret_cast<const char*>(lights.data()), sizeof(SceneLightRecord) * lights.size());
+	output.write(reinterpret_cast<const char*>(objects.data()), sizeof(SceneObjectRecord) * objects.size());
+
+	return output.good();
+}
+
+bool Scene::LoadBinary(const char* path)
+{
+	Clear();
+
+	MappedFile file;
+	if (!file.Open(path) || file.Size() < sizeof(SceneFileHeader))
+	{
+		std::cout << "ERROR::SCENE::CANNOT_MAP " << path << std::endl;
+		return false;
+	}
+
+	SceneFileHeader header;
+	memcpy(&header, file.Data(), sizeof(header));
+	size_t expectedSize = sizeof(SceneFileHeader)
+		+ sizeof(SceneTextureRecord) * size_t(header.textureCount)
+		+ sizeof(SceneLightRecord) * size_t(header.lightCount)
+		+ sizeof(SceneObjectRecord) * size_t(header.objectCount);
+	if (memcmp(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != SCENE_FILE_VERSION || file.Size() != expectedSize)
+	{
+		std::cout << "ERROR::SCENE::CORRUPT " << path << std::endl;
+		return false;
+	}
+
+	const SceneTextureRecord* textures = reinterpret_cast<const SceneTextureRecord*>(file.Data() + sizeof(SceneFileHeader));
+	const SceneLightRecord* lights = reinterpret_cast<const SceneLightRecord*>(textures + header.textureCount);
+	const SceneObjectRecord* objects = reinterpret_cast<const SceneObjectRecord*>(lights + header.lightCount);
+
+	texturePaths.reserve(header.textureCount);
+	for (GLuint i = 0; i < header.textureCount; i++)
+		texturePaths.push_back(std::string(textures[i].path, strnlen(textures[i].path, SCENE_PATH_LENGTH)));
+
+	lightPositions.reserve(header.lightCount);
+	lightColors.reserve(header.lightCount);
+	for (GLuint i = 0; i < header.lightCount; i++)
+	{
+		lightPositions.push_back(glm::vec3(lights[i].position[0], lights[i].position[1], lights[i].position[2]));
+		lightColors.push_back(glm::vec3(lights[i].color[0], lights[i].color[1], lights[i].color[2]));
+	}
+
+	meshTypes.reserve(header.objectCount);
+	textureIndices.reserve(header.objectCount);
+	models.reserve(header.objectCount);
+	tints.reserve(header.objectCount);
+	features.reserve(header.objectCount);
+	for (GLuint i = 0; i < header.objectCount; i++)
+	{
+		const SceneObjectRecord& object = objects[i];
+		if (object.mesh >= MESH_COUNT || object.texture >= header.textureCount)
+		{
+			std::cout << "ERROR::SCENE::CORRUPT " << path << std::endl;
+			Clear();
+			return false;
+		}
+
+		// Model matrix: transformations are applied right-to-left order
+		glm::mat4 translation = glm::translate(glm::vec3(object.translation[0], object.translation[1], object.translation[2]));
+		glm::mat4 rotation = glm::rotate(object.angle, glm::vec3(object.axis[0], object.axis[1], object.axis[2]));
+		glm::mat4 scale = glm::scale(glm::vec3(object.scale[0], object.scale[1], object.scale[2]));
+
+		meshTypes.push_back(MeshType(object.mesh));
+		textureIndices.push_back(object.texture);
+		models.push_back(translation * rotation * scale);
+		tints.push_back(glm::vec4(object.tint[0], object.tint[1], object.tint[2], object.tint[3]));
+		features.push_back(object.features);
+	}
+
+	return true;
+}
+
+void Scene::Clear()
+{
+	texturePaths.clear();
+	lightPositions.clear();
+	lightColors.clear();
+	meshTypes.clear();
+	textureIndices.clear();
+	models.clear();
+	tints.clear();
+	features.clear();
+}
@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////
+// scene.h
+// ========
+// data-driven scene description: which mesh, texture, transform and material
+// features each object uses, and the point lights. Scenes are authored as
+// text and compiled to a binary file of fixed-size records that is
+// memory-mapped on load.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "meshes.h"
+
+// Compiled scene file layout: header, texture records, light records, object records
+const char SCENE_FILE_MAGIC[4] = { 'S', 'C', 'N', 'B' };
+const GLuint SCENE_FILE_VERSION = 3;
+const GLuint SCENE_PATH_LENGTH = 128;
+
+struct SceneFileHeader
+{
+	char magic[4];
+	GLuint version;
+	GLuint textureCount;
+	GLuint lightCount;
+	GLuint objectCount;
+};
+
+struct SceneTextureRecord
+{
+	char path[SCENE_PATH_LENGTH];
+};
+
+struct SceneLightRecord
+{
+	GLfloat position[3];
+	GLfloat color[3];
+};
+
+struct SceneObjectRecord
+{
+	GLuint mesh;                // MeshType
+	GLuint texture;             // Index into the texture records
+	GLfloat translation[3];
+	GLfloat axis[3];            // Rotation axis
+	GLfloat angle;              // Rotation angle in radians
+	GLfloat scale[3];
+	GLfloat tint[4];            // Color multiplied into the texture (defaults to white)
+	GLuint features;            // MaterialFeature flags (defaults to MATERIAL_DEFAULT_FEATURES)
+};
+
+class Scene
+{
+public:
+	// Loads a text scene, recompiling its binary form first if that is
+	// missing or older than the text
+	bool Load(const char* path);
+
+	// Parses a text scene and writes the compiled binary form
+	static bool Compile(const char* textPath, const char* binaryPath);
+
+	GLuint ObjectCount() const { return GLuint(models.size()); }
+
+	void Clear();
+
+public:
+	// Flat per-scene data
+	std::vector<std::string> texturePaths;
+	std::vector<glm::vec3> lightPositions;
+	std::vector<glm::vec3> lightColors;
+
+	// Flat per-object data, all indexed by object
+	std::vector<MeshType> meshTypes;
+	std::vector<GLuint> textureIndices;
+	std::vector<glm::mat4> models;
+	std::vector<glm::vec4> tints;
+	std::vector<GLuint> features;
+
+private:
+	bool LoadBinary(const char* path);
+};
@@ -1,101 +1,33 @@
 #ifndef SHADER_H
 #define SHADER_H
 
-#include <glad/glad.h>
+#include <GL/glew.h>
 
 #include <glm/glm.hpp>
 
+#include "shadermanager.h"
+#include "uniforms.h"
+
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <iostream>
 
 class Shader
 {
 public:
 	unsigned int ID;
-	// constructor generates the shader on the fly
+	// constructor builds the program through the shared shader module, so
+	// these files get #include, the program cache and error reporting too
 	// ------------------------------------------------------------------------
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
 	{
-		// 1. retrieve the vertex/fragment source code from filePath
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
-		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-			// if geometry shader path is present, also load a geometry shader
-			if (geometryPath != nullptr)
-			{
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryCode = gShaderStream.str();
-			}
-		}
-		catch (std::ifstream::failure& e)
-		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
-		{
-			const char * gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
-		}
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
+		ProgramDesc desc;
+		desc.vertex = ShaderSource::File(vertexPath);
+		desc.fragment = ShaderSource::File(fragmentPath);
 		if (geometryPath != nullptr)
-			glAttachShader(ID, geometry);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessery
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
-			glDeleteShader(geometry);
-
+			desc.geometry = ShaderSource::File(geometryPath);
+		ID = UBuildProgram(desc);
+		// enumerate the active uniforms once so the setters below never ask the driver by name
+		if (ID != 0)
+			uniforms.Reflect(ID);
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
@@ -103,211 +35,82 @@ public:
 	{
 		glUseProgram(ID);
 	}
-	// utility uniform functions
+	// resolve a typed uniform handle once; Set() on it does no lookups at all
+	// ------------------------------------------------------------------------
+	template <typename T>
+	Uniform<T> getUniform(const char* name) const
+	{
+		return uniforms.Get<T>(name);
+	}
+	// utility uniform functions: the slow path. Each call hashes the name and
+	// looks it up again, so anything set per frame or per draw should keep a
+	// getUniform() handle instead; these are for one-off setup
 	// ------------------------------------------------------------------------
 	void setBool(const std::string &name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(location(name), (int)value);
 	}
 	// ------------------------------------------------------------------------
 	void setInt(const std::string &name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(location(name), value);
 	}
 	// ------------------------------------------------------------------------
 	void setFloat(const std::string &name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(location(name), value);
 	}
 	// ------------------------------------------------------------------------
 	void setVec2(const std::string &name, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(location(name), 1, &value[0]);
 	}
 	void setVec2(const std::string &name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(location(name), x, y);
 	}
 	// ------------------------------------------------------------------------
 	void setVec3(const std::string &name, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(location(name), 1, &value[0]);
 	}
 	void setVec3(const std::string &name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(location(name), x, y, z);
 	}
 	// ------------------------------------------------------------------------
 	void setVec4(const std::string &name, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(location(name), 1, &value[0]);
 	}
 	void setVec4(const std::string &name, float x, float y, float z, float w)
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(location(name), x, y, z, w);
 	}
 	// ------------------------------------------------------------------------
 	void setMat2(const std::string &name, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
 	void setMat3(const std::string &name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
 	void setMat4(const std::string &name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
-	// utility function for checking shader compilation/linking errors.
+	UniformTable uniforms;
+
+	// cached location of a uniform, looked up by interned name on every call
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(GLuint shader, std::string type)
+	GLint location(const std::string &name) const
 	{
-		GLint success;
-		GLchar infoLog[1024];
-		if (type != "PROGRAM")
-		{
-			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-			if (!success)
-			{
-				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-			}
-		}
-		else
-		{
-			glGetProgramiv(shader, GL_LINK_STATUS, &success);
-			if (!success)
-			{
-				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-			}
-		}
+		return uniforms.Location(UInternUniformName(name.c_str()));
 	}
 };
 #endif
-//#ifndef SHADER_H
-//#define SHADER_H
-//
-//#include <glad/glad.h>
-//
-//#include <string>
-//#include <fstream>
-//#include <sstream>
-//#include <iostream>
-//
-//class Shader
-//{
-//public:
-//	unsigned int ID;
-//	// constructor generates the shader on the fly
-//	// ------------------------------------------------------------------------
-//	Shader(const char* vertexPath, const char* fragmentPath)
-//	{
-//		// 1. retrieve the vertex/fragment source code from filePath
-//		std::string vertexCode;
-//		std::string fragmentCode;
-//		std::ifstream vShaderFile;
-//		std::ifstream fShaderFile;
-//		// ensure ifstream objects can throw exceptions:
-//		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-//		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-//		try
-//		{
-//			// open files
-//			vShaderFile.open(vertexPath);
-//			fShaderFile.open(fragmentPath);
-//			std::stringstream vShaderStream, fShaderStream;
-//			// read file's buffer contents into streams
-//			vShaderStream << vShaderFile.rdbuf();
-//			fShaderStream << fShaderFile.rdbuf();
-//			// close file handlers
-//			vShaderFile.close();
-//			fShaderFile.close();
-//			// convert stream into string
-//			vertexCode = vShaderStream.str();
-//			fragmentCode = fShaderStream.str();
-//		}
-//		catch (std::ifstream::failure& e)
-//		{
-//			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-//		}
-//		const char* vShaderCode = vertexCode.c_str();
-//		const char * fShaderCode = fragmentCode.c_str();
-//		// 2. compile shaders
-//		unsigned int vertex, fragment;
-//		// vertex shader
-//		vertex = glCreateShader(GL_VERTEX_SHADER);
-//		glShaderSource(vertex, 1, &vShaderCode, NULL);
-//		glCompileShader(vertex);
-//		checkCompileErrors(vertex, "VERTEX");
-//		// fragment Shader
-//		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-//		glShaderSource(fragment, 1, &fShaderCode, NULL);
-//		glCompileShader(fragment);
-//		checkCompileErrors(fragment, "FRAGMENT");
-//		// shader Program
-//		ID = glCreateProgram();
-//		glAttachShader(ID, vertex);
-//		glAttachShader(ID, fragment);
-//		glLinkProgram(ID);
-//		checkCompileErrors(ID, "PROGRAM");
-//		// delete the shaders as they're linked into our program now and no longer necessary
-//		glDeleteShader(vertex);
-//		glDeleteShader(fragment);
-//	}
-//	// activate the shader
-//	// ------------------------------------------------------------------------
-//	void use()
-//	{
-//		glUseProgram(ID);
-//	}
-//	// utility uniform functions
-//	// ------------------------------------------------------------------------
-//	void setBool(const std::string &name, bool value) const
-//	{
-//		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
-//	}
-//	// ------------------------------------------------------------------------
-//	void setInt(const std::string &name, int value) const
-//	{
-//		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
-//	}
-//	// ------------------------------------------------------------------------
-//	void setFloat(const std::string &name, float value) const
-//	{
-//		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
-//	}
-//
-//private:
-//	// utility function for checking shader compilation/linking errors.
-//	// ------------------------------------------------------------------------
-//	void checkCompileErrors(unsigned int shader, std::string type)
-//	{
-//		int success;
-//		char infoLog[1024];
-//		if (type != "PROGRAM")
-//		{
-//			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-//			if (!success)
-//			{
-//				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-//				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-//			}
-//		}
-//		else
-//		{
-//			glGetProgramiv(shader, GL_LINK_STATUS, &success);
-//			if (!success)
-//			{
-//				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-//				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-//			}
-//		}
-//	}
-//};
-//#endif
\ No newline at end of file
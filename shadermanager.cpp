@@ -0,0 +1,514 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadermanager.cpp
+// ========
+// the one place shader programs are built: stages come from inline GLSL or
+// from files, #include "file" lines are expanded and compile-time defines
+// are added after #version, so permutations of one source share it. Linked
+// programs go through the program cache and have their uniforms reflected.
+// Programs whose files change on disk are rebuilt the same way and swapped
+// in once they link.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shadermanager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "programcache.h"
+
+namespace
+{
+	// Deeper nesting than this is taken to be an include cycle
+	const int MAX_INCLUDE_DEPTH = 16;
+
+	const GLenum STAGE_TYPES[] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+	const char* const STAGE_NAMES[] = { "VERTEX", "GEOMETRY", "FRAGMENT" };
+
+	// Names inline text in compile errors; it has no directory to look in either
+	const char* const INLINE_SOURCE_NAME = "<inline>";
+
+	bool ReadTextFile(const std::string& path, std::string& text)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		if (!file.is_open())
+			return false;
+
+		std::stringstream stream;
+		stream << file.rdbuf();
+		text = stream.str();
+		return true;
+	}
+
+	// Everything up to and including the last separator; empty for a bare name
+	std::string DirectoryOf(const std::string& path)
+	{
+		const size_t separator = path.find_last_of("/\\");
+		return separator == std::string::npos ? std::string() : path.substr(0, separator + 1);
+	}
+
+	void AddFile(std::vector<std::string>& files, const std::string& path)
+	{
+		if (std::find(files.begin(), files.end(), path) == files.end())
+			files.push_back(path);
+	}
+
+	// True, with name set, if [begin, end) is an #include "name" line
+	bool ParseInclude(const char* begin, const char* end, std::string& name)
+	{
+		while (begin < end && (*begin == ' ' || *begin == '\t'))
+			begin++;
+		if (end - begin < 8 || strncmp(begin, "#include", 8) != 0)
+			return false;
+
+		const char* open = std::find(begin + 8, end, '"');
+		const char* close = open == end ? end : std::find(open + 1, end, '"');
+		if (close == end)
+			return false;
+
+		name.assign(open + 1, close);
+		return true;
+	}
+
+	///////////////////////////////////////////////////
+	//	ExpandIncludes(const std::string&, const std::string&, GLuint, int, ...)
+	//
+	//	text: one file's GLSL, or inline text
+	//	name: its path, which includes are resolved against
+	//	index: its source string number
+	//	sources: receives each included file under the
+	//	source string number its #line directives use
+	//
+	//	Appends text to output with every #include line
+	//	replaced by the file it names, bracketed by #line
+	//	directives so compile errors point at the right
+	//	file and line (GLSL 3.30 and later semantics)
+	///////////////////////////////////////////////////
+	bool ExpandIncludes(const std::string& text, const std::string& name, GLuint index, int depth,
+		std::string& output, std::vector<std::string>& sources, std::vector<std::string>& files)
+	{
+		int line = 1;
+		for (size_t position = 0; position < text.size(); line++)
+		{
+			size_t end = text.find('\n', position);
+			if (end == std::string::npos)
+				end = text.size();
+
+			std::string includeName;
+			if (!ParseInclude(text.data() + position, text.data() + end, includeName))
+			{
+				output.append(text, position, end + 1 - position);
+				position = end + 1;
+				continue;
+			}
+			position = end + 1;
+
+			const std::string path = DirectoryOf(name) + includeName;
+			std::string included;
+			if (depth >= MAX_INCLUDE_DEPTH)
+			{
+				std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP " << path << " from " << name << ":" << line << std::endl;
+				return false;
+			}
+			if (!ReadTextFile(path, included))
+			{
+				std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND " << path << " from " << name << ":" << line << std::endl;
+				return false;
+			}
+
+			const GLuint includedIndex = GLuint(sources.size());
+			sources.push_back(path);
+			AddFile(files, path);
+
+			output += "#line 1 " + std::to_string(includedIndex) + "\n";
+			if (!ExpandIncludes(included, path, includedIndex, depth + 1, output, sources, files))
+				return false;
+			if (!output.empty() && output.back() != '\n')
+				output += '\n';
+			output += "#line " + std::to_string(line + 1) + " " + std::to_string(index) + "\n";
+		}
+		return true;
+	}
+
+	// Reads one stage, expands its includes and puts the defines right after
+	// its #version line, which must stay first
+	bool ExpandStage(const ShaderSource& source, const std::vector<std::string>& defines,
+		std::string& output, std::vector<std::string>& sources, std::vector<std::string>& files)
+	{
+		std::string text;
+		const std::string name = source.text != nullptr ? std::string(INLINE_SOURCE_NAME) : source.path;
+		if (source.text != nullptr)
+			text = source.text;
+		else if (!ReadTextFile(source.path, text))
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_READ " << source.path << std::endl;
+			return false;
+		}
+		else
+			AddFile(files, source.path);
+
+		sources.assign(1, name);
+		output.clear();
+		if (!ExpandIncludes(text, name, 0, 0, output, sources, files))
+			return false;
+
+		if (defines.empty())
+			return true;
+
+		// Lines before #version can only be comments or blank
+		size_t versionEnd = 0;
+		int versionLine = 0;
+		for (size_t position = 0; position < output.size(); versionLine++)
+		{
+			size_t end = output.find('\n', position);
+			end = end == std::string::npos ? output.size() : end + 1;
+			const size_t start = output.find_first_not_of(" \t", position);
+			if (start < end && output.compare(start, 8, "#version") == 0)
+			{
+				versionEnd = end;
+				versionLine++;
+				break;
+			}
+			position = end;
+		}
+		if (versionEnd == 0)
+			versionLine = 0;
+
+		std::string block;
+		for (const std::string& define : defines)
+			block += "#define " + define + "\n";
+		block += "#line " + std::to_string(versionLine + 1) + " 0\n";
+		output.insert(versionEnd, block);
+		return true;
+	}
+
+	// Print a shader's compile log if it failed, naming the file behind each
+	// source string number it mentions; true if it compiled
+	bool CheckCompile(GLuint shader, const char* stage, const std::vector<std::string>& sources)
+	{
+		GLint success = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			GLint length = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+			std::vector<char> infoLog(size_t(std::max(length, 1)), '\0');
+			glGetShaderInfoLog(shader, GLsizei(infoLog.size()), NULL, infoLog.data());
+			std::cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED\n" << infoLog.data() << std::endl;
+			for (size_t i = 0; i < sources.size(); i++)
+				std::cout << "  source " << i << ": " << sources[i] << std::endl;
+		}
+		return success != 0;
+	}
+}
+
+ShaderSource ShaderSource::Inline(const char* text)
+{
+	ShaderSource source;
+	source.text = text;
+	return source;
+}
+
+ShaderSource ShaderSource::File(const char* path)
+{
+	ShaderSource source;
+	source.path = path;
+	return source;
+}
+
+void ShaderManager::Start()
+{
+	// Asking for the maximum lets the driver pick its own thread count
+	if (GLEW_KHR_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		parallel = true;
+	}
+	else if (GLEW_ARB_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		parallel = true;
+	}
+}
+
+GLuint ShaderManager::Submit(const ProgramDesc& desc)
+{
+	Entry entry;
+	entry.desc = desc;
+	Build(entry);
+	if (watching)
+		Watch(entry);
+	entries.push_back(std::move(entry));
+	return GLuint(entries.size() - 1);
+}
+
+///////////////////////////////////////////////////
+//	Build(Entry&)
+//
+//	entry: desc set; receives the program, or is
+//	left finished and unlinked if a source could not
+//	be read
+//
+//	No status is queried here: the link is issued
+//	straight after the compiles, and a failed compile
+//	simply fails the link, which Finish reports
+///////////////////////////////////////////////////
+void ShaderManager::Build(Entry& entry)
+{
+	const ShaderSource* sources[STAGE_COUNT] = { &entry.desc.vertex, &entry.desc.geometry, &entry.desc.fragment };
+	std::string texts[STAGE_COUNT];
+	entry.files.clear();
+	for (int i = 0; i < STAGE_COUNT; i++)
+	{
+		if (sources[i]->IsEmpty())
+			continue;
+		if (!ExpandStage(*sources[i], entry.desc.defines, texts[i], entry.stages[i].sources, entry.files))
+		{
+			entry.finished = true;
+			return;
+		}
+	}
+
+	// The key covers the expanded text, so an edited include or another
+	// permutation never picks up a stale binary
+	const auto text = [&](int stage) { return sources[stage]->IsEmpty() ? nullptr : texts[stage].c_str(); };
+	entry.cacheKey = UProgramCacheKey({ text(STAGE_VERTEX), text(STAGE_GEOMETRY), text(STAGE_FRAGMENT) });
+	if (ULoadProgramBinary(entry.cacheKey, entry.program))
+	{
+		entry.finished = true;
+		entry.linked = true;
+		entry.uniforms.Reflect(entry.program);
+		return;
+	}
+
+	entry.program = glCreateProgram();
+	glProgramParameteri(entry.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	for (int i = 0; i < STAGE_COUNT; i++)
+	{
+		if (sources[i]->IsEmpty())
+			continue;
+
+		const char* stageText = texts[i].c_str();
+		entry.stages[i].shader = glCreateShader(STAGE_TYPES[i]);
+		glShaderSource(entry.stages[i].shader, 1, &stageText, NULL);
+		glCompileShader(entry.stages[i].shader);
+		glAttachShader(entry.program, entry.stages[i].shader);
+	}
+	glLinkProgram(entry.program);
+}
+
+bool ShaderManager::Ready(GLuint handle) const
+{
+	const Entry& entry = entries[handle];
+	if (entry.finished || !parallel)
+		return true;
+
+	GLint complete = GL_FALSE;
+	glGetProgramiv(entry.program, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete == GL_TRUE;
+}
+
+GLuint ShaderManager::Program(GLuint handle)
+{
+	Entry& entry = entries[handle];
+	if (!entry.finished)
+		Finish(entry);
+	return entry.linked ? entry.program : 0;
+}
+
+const UniformTable& ShaderManager::Uniforms(GLuint handle)
+{
+	Entry& entry = entries[handle];
+	if (!entry.finished)
+		Finish(entry);
+	return entry.uniforms;
+}
+
+bool ShaderManager::FinishAll()
+{
+	bool linked = true;
+	for (Entry& entry : entries)
+	{
+		if (!entry.finished)
+			Finish(entry);
+		linked &= entry.linked;
+	}
+	return linked;
+}
+
+///////////////////////////////////////////////////
+//	Finish(Entry&)
+//
+//	The first status query waits for the driver.
+//	On success the binary is stored for the next run
+//	and the uniforms are reflected; either way the
+//	shader objects are released.
+///////////////////////////////////////////////////
+bool ShaderManager::Finish(Entry& entry)
+{
+	GLint success = 0;
+	glGetProgramiv(entry.program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		// A compile error is more useful than the link error it caused
+		bool compiled = true;
+		for (int i = 0; i < STAGE_COUNT && compiled; i++)
+		{
+			if (entry.stages[i].shader != 0)
+				compiled = CheckCompile(entry.stages[i].shader, STAGE_NAMES[i], entry.stages[i].sources);
+		}
+		if (compiled)
+		{
+			GLint length = 0;
+			glGetProgramiv(entry.program, GL_INFO_LOG_LENGTH, &length);
+			std::vector<char> infoLog(size_t(std::max(length, 1)), '\0');
+			glGetProgramInfoLog(entry.program, GLsizei(infoLog.size()), NULL, infoLog.data());
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog.data() << std::endl;
+		}
+	}
+	else
+	{
+		USaveProgramBinary(entry.cacheKey, entry.program);
+		entry.uniforms.Reflect(entry.program);
+	}
+
+	for (Stage& stage : entry.stages)
+	{
+		if (stage.shader == 0)
+			continue;
+		glDetachShader(entry.program, stage.shader);
+		glDeleteShader(stage.shader);
+		stage.shader = 0;
+	}
+
+	entry.finished = true;
+	entry.linked = success != 0;
+	return entry.linked;
+}
+
+void ShaderManager::WatchFiles()
+{
+	watching = true;
+	for (const Entry& entry : entries)
+		Watch(entry);
+}
+
+void ShaderManager::Watch(const Entry& entry)
+{
+	for (const std::string& file : entry.files)
+		watcher.Watch(file);
+}
+
+///////////////////////////////////////////////////
+//	Update()
+//
+//	A program edited again before its rebuild is
+//	done starts over from the newer files. Without
+//	parallel compilation a rebuild is waited for in
+//	the frame that starts it.
+///////////////////////////////////////////////////
+GLuint ShaderManager::Update()
+{
+	if (!watching)
+		return 0;
+
+	changed.clear();
+	watcher.Poll(changed);
+	for (GLuint handle = 0; handle < entries.size() && !changed.empty(); handle++)
+	{
+		const std::vector<std::string>& files = entries[handle].files;
+		auto file = std::find_first_of(changed.begin(), changed.end(), files.begin(), files.end());
+		if (file == changed.end())
+			continue;
+
+		auto pending = std::find_if(reloads.begin(), reloads.end(), [&](const Reload& reload) { return reload.handle == handle; });
+		if (pending != reloads.end())
+		{
+			Delete(pending->entry);
+			reloads.erase(pending);
+		}
+
+		std::cout << "INFO: rebuilding shader program " << handle << " after " << *file << " changed" << std::endl;
+		Reload reload;
+		reload.handle = handle;
+		reload.entry.desc = entries[handle].desc;
+		Build(reload.entry);
+		reloads.push_back(std::move(reload));
+	}
+
+	GLuint swapped = 0;
+	for (size_t i = 0; i < reloads.size(); )
+	{
+		Entry& rebuilt = reloads[i].entry;
+		if (!rebuilt.finished && parallel)
+		{
+			GLint complete = GL_FALSE;
+			glGetProgramiv(rebuilt.program, GL_COMPLETION_STATUS_KHR, &complete);
+			if (complete != GL_TRUE)
+			{
+				i++;
+				continue;
+			}
+		}
+		if (!rebuilt.finished)
+			Finish(rebuilt);
+
+		Entry& entry = entries[reloads[i].handle];
+		if (rebuilt.linked)
+		{
+			// A new include is watched from now on
+			Watch(rebuilt);
+			Delete(entry);
+			entry = std::move(rebuilt);
+			swapped++;
+		}
+		else
+		{
+			std::cout << "ERROR::SHADER::RELOAD_FAILED program " << reloads[i].handle << " kept" << std::endl;
+			Delete(rebuilt);
+		}
+		reloads.erase(reloads.begin() + i);
+	}
+	return swapped;
+}
+
+void ShaderManager::Delete(Entry& entry)
+{
+	for (Stage& stage : entry.stages)
+	{
+		glDeleteShader(stage.shader);
+		stage.shader = 0;
+	}
+	glDeleteProgram(entry.program);
+	entry.program = 0;
+}
+
+void ShaderManager::Destroy()
+{
+	for (Entry& entry : entries)
+		Delete(entry);
+	for (Reload& reload : reloads)
+		Delete(reload.entry);
+	entries.clear();
+	reloads.clear();
+	watcher.Stop();
+	watching = false;
+}
+
+GLuint UBuildProgram(const ProgramDesc& desc)
+{
+	ShaderManager::Entry entry;
+	entry.desc = desc;
+	ShaderManager::Build(entry);
+	if (!entry.finished)
+		ShaderManager::Finish(entry);
+
+	if (!entry.linked)
+	{
+		glDeleteProgram(entry.program);
+		return 0;
+	}
+	return entry.program;
+}
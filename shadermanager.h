@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadermanager.h
+// ========
+// the one place shader programs are built: stages come from inline GLSL or
+// from files, #include "file" lines are expanded and compile-time defines
+// are added after #version, so permutations of one source share it. Linked
+// programs go through the program cache and have their uniforms reflected.
+//
+// Compiles and links are all submitted up front, and a program's status is
+// only asked for when it is first needed. With GL_KHR_parallel_shader_compile
+// the driver works through them on its own threads meanwhile, and readiness
+// can be polled without blocking. The same path rebuilds programs whose
+// files change on disk while the application runs (see Update).
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+#include "filewatcher.h"
+#include "uniforms.h"
+
+// One stage's GLSL: inline text, which must outlive the manager, or a file.
+// Includes are looked up next to the file, or from the working directory
+// for inline text.
+struct ShaderSource
+{
+	const char* text = nullptr;     // Null for a file
+	std::string path;
+
+	static ShaderSource Inline(const char* text);
+	static ShaderSource File(const char* path);
+
+	bool IsEmpty() const { return text == nullptr && path.empty(); }
+};
+
+struct ProgramDesc
+{
+	ShaderSource vertex;
+	ShaderSource geometry;              // Optional
+	ShaderSource fragment;
+	std::vector<std::string> defines;   // "NAME" or "NAME VALUE", given to every stage
+};
+
+class ShaderManager
+{
+public:
+	ShaderManager() = default;
+	~ShaderManager() = default;
+
+	ShaderManager(const ShaderManager&) = delete;
+	ShaderManager& operator=(const ShaderManager&) = delete;
+
+	// Lets the driver use as many compiler threads as it likes, where it
+	// supports parallel compilation. Needs a current context.
+	void Start();
+
+	// Reads and expands every stage, then hands the driver the compiles and
+	// the link, or loads the cached binary, without waiting on any of it.
+	// Returns the handle the other calls take; a source that cannot be read
+	// is reported here and leaves a program that failed.
+	GLuint Submit(const ProgramDesc& desc);
+
+	// True once Program would not wait on the driver. Without parallel
+	// compilation the driver cannot be asked, so this is always true.
+	bool Ready(GLuint handle) const;
+
+	// The linked program, waiting for it the first time and reporting any
+	// compile or link errors then; 0 if it failed
+	GLuint Program(GLuint handle);
+
+	// Active uniforms of the program, reflected once it has linked (empty if it failed)
+	const UniformTable& Uniforms(GLuint handle);
+
+	// Waits for every submitted program; false if any failed
+	bool FinishAll();
+
+	// Watch the files of every program, submitted so far or later, so that
+	// Update rebuilds the ones edited on disk
+	void WatchFiles();
+
+	// GL thread, once per frame while watching: resubmits every program whose
+	// files changed and swaps each in once its rebuild has linked, polling
+	// rather than waiting where the driver compiles in parallel. A rebuild
+	// that fails is reported and the old program kept. Returns how many
+	// programs were swapped; their Program and Uniforms have changed, so
+	// handles resolved from the old ones must be resolved again.
+	GLuint Update();
+
+	// Deletes every program; handles are invalid afterwards
+	void Destroy();
+
+private:
+	enum { STAGE_VERTEX, STAGE_GEOMETRY, STAGE_FRAGMENT, STAGE_COUNT };
+
+	struct Stage
+	{
+		GLuint shader = 0;                  // 0 once finished, or if the binary was cached
+		std::vector<std::string> sources;   // Source string number in the compile log -> file
+	};
+
+	struct Entry
+	{
+		ProgramDesc desc;
+		std::vector<std::string> files;     // Every file read, includes too
+		GLuint program = 0;
+		Stage stages[STAGE_COUNT];
+		UniformTable uniforms;
+		unsigned long long cacheKey = 0;
+		bool finished = false;
+		bool linked = false;
+	};
+
+	// A rebuild in flight; the program it replaces stays in use until it links
+	struct Reload
+	{
+		GLuint handle;
+		Entry entry;
+	};
+
+	friend GLuint UBuildProgram(const ProgramDesc& desc);
+
+	static void Build(Entry& entry);
+	static bool Finish(Entry& entry);
+	static void Delete(Entry& entry);
+	void Watch(const Entry& entry);
+
+	std::vector<Entry> entries;
+	std::vector<Reload> reloads;
+	bool parallel = false;          // Set by Start from the extensions
+	bool watching = false;
+	FileWatcher watcher;
+	std::vector<std::string> changed;   // Scratch for Update, kept to avoid reallocating
+};
+
+// Builds one program at once, for callers outside the frame loop; the caller
+// owns the result and deletes it. 0 if it failed.
+GLuint UBuildProgram(const ProgramDesc& desc);
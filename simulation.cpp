@@ -0,0 +1,258 @@
+///////////////////////////////////////////////////////////////////////////////
+// simulation.cpp
+// ========
+// fixed-timestep simulation on its own thread: it owns the camera, advances
+// it at a steady tick rate from the input events the window callbacks queue,
+// and publishes each tick as an immutable snapshot through a triple buffer.
+// The render loop blends the last two ticks for the instant it draws, so
+// neither side waits on the other and a slow frame never changes how far the
+// camera moves.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Behind by more than this (a debugger break, a suspended machine), the
+	// missed ticks are dropped rather than run back to back
+	const int MAX_CATCH_UP_TICKS = 8;
+
+	const float MIN_SENSITIVITY = 0.01f;
+	const float MAX_SENSITIVITY = 3.0f;
+	const float SENSITIVITY_PER_SCROLL_STEP = 0.01f;
+
+	// Unit view direction for yaw and pitch in degrees
+	glm::vec3 LookDirection(float yaw, float pitch)
+	{
+		glm::vec3 front;
+		front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+		front.y = sin(glm::radians(pitch));
+		front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+		return glm::normalize(front);
+	}
+}
+
+void Simulation::Start(const CameraState& initial, double tickRate)
+{
+	Stop();
+
+	camera = initial;
+	buttons = 0;
+	sensitivity = DEFAULT_SENSITIVITY;
+	inputTime = 0.0;
+	tickSeconds = 1.0 / tickRate;
+
+	latest = SimulationSnapshot();
+	looks.clear();
+	latest.previous = initial;
+	latest.current = initial;
+
+	running = true;
+	thread = std::thread(&Simulation::Run, this);
+}
+
+void Simulation::Stop()
+{
+	running = false;
+	if (thread.joinable())
+		thread.join();
+}
+
+double Simulation::Now() const
+{
+	return std::chrono::duration<double>(Clock::now() - epoch).count();
+}
+
+bool Simulation::PushEvent(const InputEvent& event)
+{
+	if (!events.TryPush(event))
+		return false;
+	if (event.type == INPUT_EVENT_LOOK)
+		looks.push_back(event);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Sample(double)
+//
+//	now: normally Now()
+//
+//	Draws one tick behind the simulation: the newest
+//	snapshot stands for its time, and the frame lands
+//	somewhere in the tick after it, so the camera is
+//	blended from the tick before towards that one
+///////////////////////////////////////////////////
+CameraState Simulation::Sample(double now)
+{
+	snapshots.Read(latest);
+
+	// Events are applied in order, so everything up to the snapshot's stamp is in it
+	const double applied = latest.inputTime;
+	looks.erase(looks.begin(), std::find_if(looks.begin(), looks.end(),
+		[applied](const InputEvent& look) { return look.time > applied; }));
+
+	const float alpha = float(glm::clamp((now - latest.time) / tickSeconds, 0.0, 1.0));
+	const CameraState& from = latest.previous;
+	const CameraState& to = latest.current;
+
+	CameraState blended = to;
+	blended.position = glm::mix(from.position, to.position, alpha);
+	blended.front = glm::normalize(glm::mix(from.front, to.front, alpha));
+	blended.yaw = glm::mix(from.yaw, to.yaw, alpha);
+	blended.pitch = glm::mix(from.pitch, to.pitch, alpha);
+
+	// A tick before any input has no stamp to blend from
+	const double fromInput = latest.previousInputTime > 0.0 ? latest.previousInputTime : latest.inputTime;
+	sampledInputTime = glm::mix(fromInput, latest.inputTime, double(alpha));
+	return blended;
+}
+
+///////////////////////////////////////////////////
+//	SampleLatched(double)
+//
+//	now: normally Now()
+//
+//	Position still blends between the last two ticks.
+//	Look events are discrete, so they start from the
+//	newest tick, not the blend, and the ones still
+//	queued are added on top the way Step will add them;
+//	the next frame then continues from where this one
+//	turned to instead of stepping back.
+///////////////////////////////////////////////////
+CameraState Simulation::SampleLatched(double now)
+{
+	CameraState latched = Sample(now);
+	latched.yaw = latest.current.yaw;
+	latched.pitch = latest.current.pitch;
+	latched.front = latest.current.front;
+	if (looks.empty())
+		return latched;
+
+	for (const InputEvent& look : looks)
+	{
+		latched.yaw += look.value.x * latest.sensitivity;
+		latched.pitch += look.value.y * latest.sensitivity;
+	}
+	latched.pitch = glm::clamp(latched.pitch, -89.0f, 89.0f);
+	latched.front = LookDirection(latched.yaw, latched.pitch);
+	sampledInputTime = looks.back().time;
+	return latched;
+}
+
+///////////////////////////////////////////////////
+//	Run()
+//
+//	Each tick is scheduled on a fixed grid from the
+//	first tick and stamped with its grid time, so render
+//	interpolation is unaffected by how late the
+//	thread actually woke up
+///////////////////////////////////////////////////
+void Simulation::Run()
+{
+	const Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tickSeconds));
+	Clock::time_point next = Clock::now();
+
+	SimulationSnapshot snapshot = latest;
+	while (running.load(std::memory_order_relaxed))
+	{
+		snapshot.previous = camera;
+		snapshot.previousInputTime = inputTime;
+		Step(float(tickSeconds));
+		snapshot.tick++;
+		snapshot.time = std::chrono::duration<double>(next - epoch).count();
+		snapshot.current = camera;
+		snapshot.inputTime = inputTime;
+		snapshot.sensitivity = sensitivity;
+		snapshots.Write(snapshot);
+
+		next += tick;
+		const Clock::time_point now = Clock::now();
+		if (now - next > tick * MAX_CATCH_UP_TICKS)
+			next = now;
+		std::this_thread::sleep_until(next);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Step(float)
+//
+//	seconds: length of one tick
+//
+//	Applies the events queued since the last tick
+//	in the order they happened, then WASD pans and
+//	Q/E pitches for the tick. Mouse look and
+//	movement are both scaled by the sensitivity the
+//	scroll wheel sets.
+///////////////////////////////////////////////////
+void Simulation::Step(float seconds)
+{
+	bool turned = false;
+	InputEvent event;
+	while (events.TryPop(event))
+	{
+		inputTime = event.time;
+		switch (event.type)
+		{
+		case INPUT_EVENT_LOOK:
+			camera.yaw += event.value.x * sensitivity;
+			camera.pitch += event.value.y * sensitivity;
+			turned = true;
+			break;
+
+		case INPUT_EVENT_BUTTON_DOWN:
+			buttons |= event.button;
+			break;
+
+		case INPUT_EVENT_BUTTON_UP:
+			buttons &= ~event.button;
+			break;
+
+		case INPUT_EVENT_SENSITIVITY:
+			sensitivity = glm::clamp(sensitivity + SENSITIVITY_PER_SCROLL_STEP * event.value.y, MIN_SENSITIVITY, MAX_SENSITIVITY);
+			break;
+
+		case INPUT_EVENT_SENSITIVITY_RESET:
+			sensitivity = DEFAULT_SENSITIVITY;
+			break;
+
+		case INPUT_EVENT_TOGGLE_ORTHO:
+			camera.ortho = !camera.ortho;
+			break;
+		}
+	}
+
+	const float cameraSpeed = 25.0f * seconds * sensitivity;
+	if (buttons & INPUT_PITCH_UP)
+	{
+		camera.pitch += cameraSpeed * 5;
+		turned = true;
+	}
+	if (buttons & INPUT_PITCH_DOWN)
+	{
+		camera.pitch -= cameraSpeed * 5;
+		turned = true;
+	}
+
+	// The initial front is set directly; only turning derives it from yaw and pitch
+	if (turned)
+	{
+		// make sure that when pitch is out of bounds, screen doesn't get flipped
+		camera.pitch = glm::clamp(camera.pitch, -89.0f, 89.0f);
+		camera.front = LookDirection(camera.yaw, camera.pitch);
+	}
+
+	const glm::vec3 right = glm::normalize(glm::cross(camera.front, camera.up));
+	if (buttons & INPUT_FORWARD)
+		camera.position += cameraSpeed * camera.front;
+	if (buttons & INPUT_BACK)
+		camera.position -= cameraSpeed * camera.front;
+	if (buttons & INPUT_LEFT)
+		camera.position -= right * cameraSpeed;
+	if (buttons & INPUT_RIGHT)
+		camera.position += right * cameraSpeed;
+}
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// simulation.h
+// ========
+// fixed-timestep simulation on its own thread: it owns the camera, advances
+// it at a steady tick rate from the input events the window callbacks queue,
+// and publishes each tick as an immutable snapshot through a triple buffer.
+// The render loop blends the last two ticks for the instant it draws, so
+// neither side waits on the other and a slow frame never changes how far the
+// camera moves.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "queues.h"
+
+const double SIMULATION_TICK_RATE = 120.0;     // Ticks per second
+const size_t INPUT_EVENT_CAPACITY = 4096;       // Events queued between two ticks before any are dropped
+
+const float DEFAULT_SENSITIVITY = 0.03f;        // Scales mouse look and movement speed
+
+// Keys the camera follows while held, as flags in InputEvent::button
+enum InputButton
+{
+	INPUT_FORWARD = 1 << 0,
+	INPUT_BACK = 1 << 1,
+	INPUT_LEFT = 1 << 2,
+	INPUT_RIGHT = 1 << 3,
+	INPUT_PITCH_UP = 1 << 4,
+	INPUT_PITCH_DOWN = 1 << 5
+};
+
+enum InputEventType : unsigned char
+{
+	INPUT_EVENT_LOOK,                   // value: mouse motion in pixels, y up
+	INPUT_EVENT_BUTTON_DOWN,            // button: one InputButton
+	INPUT_EVENT_BUTTON_UP,
+	INPUT_EVENT_SENSITIVITY,            // value.y: scroll wheel steps
+	INPUT_EVENT_SENSITIVITY_RESET,
+	INPUT_EVENT_TOGGLE_ORTHO
+};
+
+// One window callback, stamped on the simulation's clock. The callbacks only
+// record what happened; the simulation applies them in order at its next tick.
+struct InputEvent
+{
+	double time = 0.0;                  // Simulation::Now() when the callback ran
+	glm::vec2 value = glm::vec2(0.0f);
+	GLuint button = 0;
+	InputEventType type = INPUT_EVENT_LOOK;
+};
+
+struct CameraState
+{
+	glm::vec3 position;
+	glm::vec3 front;
+	glm::vec3 up;
+	float yaw;      // Degrees; front follows these once either changes
+	float pitch;
+	bool ortho;
+};
+
+// One tick's result; previous is the tick before, so a snapshot alone is
+// enough to interpolate
+struct SimulationSnapshot
+{
+	GLuint64 tick = 0;
+	double time = 0.0;          // Now() time that current stands for
+	double inputTime = 0.0;     // Stamp of the newest input event applied so far
+	double previousInputTime = 0.0;     // inputTime as of previous
+	float sensitivity = DEFAULT_SENSITIVITY;    // Scales the look events applied after current
+	CameraState previous;
+	CameraState current;
+};
+
+class Simulation
+{
+public:
+	Simulation() = default;
+	~Simulation() { Stop(); }
+
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	// Takes ownership of the camera and starts ticking
+	void Start(const CameraState& camera, double tickRate = SIMULATION_TICK_RATE);
+
+	// Joins the thread; the last published snapshot stays readable
+	void Stop();
+
+	// Window callbacks, on the render thread: queues an event for the next
+	// tick; false if the queue is full and the event was dropped
+	bool PushEvent(const InputEvent& event);
+
+	// Render thread: the camera for time now (on the Now() clock), one tick
+	// behind the simulation and blended between the two ticks around that
+	CameraState Sample(double now);
+
+	// Render thread: Sample, but with mouse look taken from the newest tick
+	// plus every look event pushed since, which the simulation has not applied
+	// yet; the freshest camera the input allows
+	CameraState SampleLatched(double now);
+
+	// Render thread: the snapshot the last Sample blended towards
+	const SimulationSnapshot& Latest() const { return latest; }
+
+	// Render thread: the input stamps of the two ticks the last Sample
+	// blended, weighted the same way as the camera, or the newest look event
+	// SampleLatched applied
+	double SampledInputTime() const { return sampledInputTime; }
+
+	// Seconds since construction on the clock snapshots and events are
+	// stamped with; safe to call from any thread
+	double Now() const;
+
+private:
+	void Run();
+	void Step(float seconds);
+
+	std::thread thread;
+	std::atomic<bool> running{ false };
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	double tickSeconds = 1.0 / SIMULATION_TICK_RATE;
+
+	SpscQueue<InputEvent> events{ INPUT_EVENT_CAPACITY };
+	TripleBuffer<SimulationSnapshot> snapshots;
+
+	// Simulation thread only
+	CameraState camera;
+	GLuint buttons = 0;             // InputButton flags held down
+	float sensitivity = DEFAULT_SENSITIVITY;
+	double inputTime = 0.0;
+
+	// Render thread only
+	SimulationSnapshot latest;
+	double sampledInputTime = 0.0;
+	std::vector<InputEvent> looks;  // Look events pushed and not yet in latest
+};
@@ -0,0 +1,244 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.cpp
+// ========
+// on-disk cache of block compressed textures: each source image is cooked
+// once into a DDS file holding its whole mip chain, named after a hash of
+// the source file's contents, and memory mapped on later runs
+///////////////////////////////////////////////////////////////////////////////
+
+#include "texturecache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "bcencoder.h"
+
+namespace
+{
+	// Bump whenever the encoder or the file layout changes
+	const unsigned long long TEXTURE_CACHE_VERSION = 5;
+
+	const uint32_t DDS_MAGIC = 0x20534444;      // "DDS "
+	const uint32_t FOURCC_DXT1 = 0x31545844;    // "DXT1"
+	const uint32_t FOURCC_DXT5 = 0x35545844;    // "DXT5"
+
+	const uint32_t DDSD_CAPS = 0x1;
+	const uint32_t DDSD_HEIGHT = 0x2;
+	const uint32_t DDSD_WIDTH = 0x4;
+	const uint32_t DDSD_PIXELFORMAT = 0x1000;
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	const uint32_t DDSD_LINEARSIZE = 0x80000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDSCAPS_COMPLEX = 0x8;
+	const uint32_t DDSCAPS_TEXTURE = 0x1000;
+	const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+	// Legacy DDS header (no DX10 extension), read and written as is on little endian
+	struct DdsHeader
+	{
+		uint32_t magic;
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t linearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		uint32_t formatSize;
+		uint32_t formatFlags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t bitMasks[4];
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+
+	static_assert(sizeof(DdsHeader) == 128, "DDS header must be 4 + 124 bytes");
+
+	// Lay out the levels of a width x height chain back to back
+	void LayoutLevels(int width, int height, size_t blockBytes, std::vector<CompressedLevel>& levels)
+	{
+		levels.clear();
+		size_t offset = 0;
+		for (;;)
+		{
+			const size_t size = UBlockCompressedSize(width, height, blockBytes);
+			levels.push_back({ width, height, offset, size });
+			offset += size;
+
+			if (width == 1 && height == 1)
+				break;
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+	}
+}
+
+unsigned long long UHashTextureSource(const unsigned char* data, size_t size)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+
+	for (int i = 0; i < 8; i++)
+	{
+		hash ^= (TEXTURE_CACHE_VERSION >> (i * 8)) & 0xFF;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string UTextureCachePath(unsigned long long hash)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.dds", hash);
+	return std::string(TEXTURE_CACHE_DIRECTORY) + "/" + name;
+}
+
+///////////////////////////////////////////////////
+//	UCookTexture(const unsigned char*, int, int, bool, CompressedTexture&)
+//
+//	chain: RGBA8 mip chain from UBuildMipChain
+//	hasAlpha: picks BC3 over BC1
+//	texture: receives the levels and the blocks
+///////////////////////////////////////////////////
+bool UCookTexture(const unsigned char* chain, int width, int height, bool hasAlpha, CompressedTexture& texture)
+{
+	if (chain == nullptr || width <= 0 || height <= 0)
+		return false;
+
+	texture.file.Close();
+	texture.format = hasAlpha ? COMPRESSED_BC3 : COMPRESSED_BC1;
+	LayoutLevels(width, height, hasAlpha ? BC3_BLOCK_BYTES : BC1_BLOCK_BYTES, texture.levels);
+	texture.blocks.resize(texture.Size());
+
+	const unsigned char* level = chain;
+	for (const CompressedLevel& target : texture.levels)
+	{
+		if (hasAlpha)
+			UEncodeBC3(level, target.width, target.height, texture.blocks.data() + target.offset);
+		else
+			UEncodeBC1(level, target.width, target.height, texture.blocks.data() + target.offset);
+		level += size_t(target.width) * target.height * 4;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	ULoadTextureCache(const char*, CompressedTexture&)
+//
+//	path: cache file written by UWriteTextureCache
+//	texture: keeps the file mapped while it is alive
+///////////////////////////////////////////////////
+bool ULoadTextureCache(const char* path, CompressedTexture& texture)
+{
+	if (!texture.file.Open(path))
+		return false;
+
+	DdsHeader header;
+	if (texture.file.Size() < sizeof(header))
+	{
+		texture.file.Close();
+		return false;
+	}
+	memcpy(&header, texture.file.Data(), sizeof(header));
+
+	const bool valid = header.magic == DDS_MAGIC && header.size == sizeof(header) - 4 &&
+		(header.formatFlags & DDPF_FOURCC) != 0 && (header.fourCC == FOURCC_DXT1 || header.fourCC == FOURCC_DXT5) &&
+		header.width > 0 && header.height > 0;
+	if (!valid)
+	{
+		std::cout << "ERROR::TEXTURE_CACHE::BAD_HEADER " << path << std::endl;
+		texture.file.Close();
+		return false;
+	}
+
+	texture.format = header.fourCC == FOURCC_DXT5 ? COMPRESSED_BC3 : COMPRESSED_BC1;
+	LayoutLevels(int(header.width), int(header.height), texture.format == COMPRESSED_BC3 ? BC3_BLOCK_BYTES : BC1_BLOCK_BYTES, texture.levels);
+
+	// Only full chains are written; anything else is left over from a crash or another tool
+	if (header.mipMapCount != texture.levels.size() || texture.file.Size() != sizeof(header) + texture.Size())
+	{
+		std::cout << "ERROR::TEXTURE_CACHE::TRUNCATED " << path << std::endl;
+		texture.levels.clear();
+		texture.file.Close();
+		return false;
+	}
+
+	texture.blocks.clear();
+	texture.dataOffset = sizeof(header);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	UWriteTextureCache(const char*, const CompressedTexture&)
+//
+//	path: destination, normally from UTextureCachePath
+//	texture: cooked levels
+//
+//	Writes to a temporary name and renames it into
+//	place, so a reader never maps a half written file
+///////////////////////////////////////////////////
+bool UWriteTextureCache(const char* path, const CompressedTexture& texture)
+{
+	if (texture.levels.empty())
+		return false;
+
+	UMakeDirectory(TEXTURE_CACHE_DIRECTORY);
+
+	DdsHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = DDS_MAGIC;
+	header.size = sizeof(header) - 4;
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = uint32_t(texture.levels[0].height);
+	header.width = uint32_t(texture.levels[0].width);
+	header.linearSize = uint32_t(texture.levels[0].size);
+	header.mipMapCount = uint32_t(texture.levels.size());
+	header.formatSize = 32;
+	header.formatFlags = DDPF_FOURCC;
+	header.fourCC = texture.format == COMPRESSED_BC3 ? FOURCC_DXT5 : FOURCC_DXT1;
+	header.caps = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+	// Two workers may cook the same image at once; each writes its own temporary
+	static std::atomic<unsigned> nTemporaries{ 0 };
+	const std::string temporaryPath = std::string(path) + "." + std::to_string(nTemporaries++) + ".tmp";
+
+	{
+		std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!output.is_open())
+		{
+			std::cout << "ERROR::TEXTURE_CACHE::CANNOT_WRITE " << temporaryPath << std::endl;
+			return false;
+		}
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		output.write(reinterpret_cast<const char*>(texture.Data()), std::streamsize(texture.Size()));
+		if (!output)
+		{
+			std::cout << "ERROR::TEXTURE_CACHE::CANNOT_WRITE " << temporaryPath << std::endl;
+			output.close();
+			std::remove(temporaryPath.c_str());
+			return false;
+		}
+	}
+
+	if (std::rename(temporaryPath.c_str(), path) != 0)
+	{
+		// Win32 will not rename over an existing file; one there already holds the same contents
+		std::remove(temporaryPath.c_str());
+		return UFileModifiedTime(path) >= 0;
+	}
+	return true;
+}
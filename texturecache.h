@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.h
+// ========
+// on-disk cache of block compressed textures: each source image is cooked
+// once into a DDS file holding its whole mip chain, named after a hash of
+// the source file's contents, and memory mapped on later runs
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+// Directory the cooked files are written to, relative to the working directory
+const char* const TEXTURE_CACHE_DIRECTORY = "TextureCache";
+
+enum CompressedFormat
+{
+	COMPRESSED_BC1,     // RGB, 8 bytes per block
+	COMPRESSED_BC3      // RGBA, 16 bytes per block
+};
+
+struct CompressedLevel
+{
+	int width;
+	int height;
+	size_t offset;      // From CompressedTexture::Data()
+	size_t size;
+};
+
+// A cooked texture: every mip level back to back, largest first. The blocks
+// live either in the mapped cache file or, right after cooking, in memory.
+class CompressedTexture
+{
+public:
+	CompressedFormat format = COMPRESSED_BC1;
+	std::vector<CompressedLevel> levels;
+
+	const unsigned char* Data() const { return file.Data() != nullptr ? file.Data() + dataOffset : blocks.data(); }
+	size_t Size() const { return levels.empty() ? 0 : levels.back().offset + levels.back().size; }
+
+private:
+	friend bool UCookTexture(const unsigned char*, int, int, bool, CompressedTexture&);
+	friend bool ULoadTextureCache(const char*, CompressedTexture&);
+
+	std::vector<unsigned char> blocks;
+	MappedFile file;
+	size_t dataOffset = 0;
+};
+
+// 64 bit FNV-1a hash of the source bytes, salted with the cache version so
+// files written by an older encoder are never picked up
+unsigned long long UHashTextureSource(const unsigned char* data, size_t size);
+
+// Cache file for a source hash, e.g. TextureCache/0123456789abcdef.dds
+std::string UTextureCachePath(unsigned long long hash);
+
+// Compress every level of an RGBA8 mip chain (laid out as UBuildMipChain
+// writes it) to BC3 if hasAlpha and to BC1 otherwise
+bool UCookTexture(const unsigned char* chain, int width, int height, bool hasAlpha, CompressedTexture& texture);
+
+// Map a cache file and point texture's levels into it; false if it is
+// missing, truncated or not a format this cache writes
+bool ULoadTextureCache(const char* path, CompressedTexture& texture);
+
+// Write a cooked texture; a partial file is never left under path
+bool UWriteTextureCache(const char* path, const CompressedTexture& texture);
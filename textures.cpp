@@ -0,0 +1,1140 @@
+///////////////////////////////////////////////////////////////////////////////
+// textures.cpp
+// ========
+// asynchronous texture loading into the layers of a few texture arrays, or
+// into separate textures sampled through bindless handles: images are decoded
+// on worker threads, resized to power of two sides and uploaded on the GL
+// thread through a pixel buffer object, with a placeholder shown until each
+// one arrives. Where S3TC is supported the workers block compress each image
+// once into the texture cache, as BC1 unless it has alpha, and later runs
+// upload the cached mip chain directly. Mips stream in: each image first goes
+// up with only its smallest levels, and finer ones follow as the objects
+// using it grow on screen.
+//
+// Loaded textures form a registry: materials are reference counted by path,
+// and images with identical contents share one layer or texture.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "textures.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "bcencoder.h"
+#include "imageops.h"
+#include "mappedfile.h"
+#include "stb_image.h"
+
+namespace
+{
+	// Decoded images waiting for the GL thread; workers yield while it is full
+	const size_t DECODED_QUEUE_CAPACITY = 64;
+
+	// Mid grey, so untextured objects are still lit visibly while loading
+	const unsigned char PLACEHOLDER_TEXEL[4] = { 128, 128, 128, 255 };
+
+	// Sources are sRGB encoded; storing them as such lets the sampler filter in
+	// linear light. Opaque images take BC1, half the size of the BC3 that
+	// images with alpha need; each format has its own array. Placeholders are
+	// never compressed.
+	const GLenum COMPRESSED_OPAQUE_FORMAT = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+	const GLenum COMPRESSED_ALPHA_FORMAT = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+	const GLenum UNCOMPRESSED_FORMAT = GL_SRGB8_ALPHA8;
+
+	const MipFilter TEXTURE_MIP_FILTER = MIP_FILTER_KAISER;
+
+	// Every image first goes up with only its levels this size (64x64) and
+	// smaller, a few KB, so the first frames show something close to final at once
+	const int STREAM_TAIL_SIZE = 64;
+
+	// Bytes of finer levels one Update may upload; the first level always
+	// goes up, so one bigger than this still arrives
+	const GLsizeiptr STREAM_UPLOAD_BUDGET = 4 * 1024 * 1024;
+
+	// Frames a bindless material may keep levels finer than it needs before
+	// they are dropped to give the memory back
+	const GLuint64 STREAM_EVICT_FRAMES = 120;
+
+	// Power of two an image side is stored at: the nearest one, so no side is
+	// stretched or shrunk by more than a factor of about 1.4, up to the largest
+	// layer size
+	int LayerSize(int size)
+	{
+		int layerSize = 1;
+		while (layerSize * 2 <= size)
+			layerSize *= 2;
+		if (size_t(size) * size > size_t(layerSize) * layerSize * 2)
+			layerSize *= 2;
+		return std::min(layerSize, TEXTURE_MAX_LAYER_SIZE);
+	}
+
+	// Decode an image to RGBA and resample each side to its LayerSize, which
+	// layerWidth and layerHeight return, in linear light across pool
+	bool LoadLayerPixels(const MappedFile& source, ThreadPool* pool, std::vector<unsigned char>& pixels, int& layerWidth, int& layerHeight)
+	{
+		int width, height, channels;
+		unsigned char* rgba = stbi_load_from_memory(source.Data(), int(source.Size()), &width, &height, &channels, 4);
+		if (rgba == nullptr)
+			return false;
+
+		layerWidth = LayerSize(width);
+		layerHeight = LayerSize(height);
+		if (width == layerWidth && height == layerHeight)
+			pixels.assign(rgba, rgba + size_t(width) * height * 4);
+		else
+			UResizeImage(rgba, width, height, layerWidth, layerHeight, pool, pixels);
+		stbi_image_free(rgba);
+		return true;
+	}
+
+	// True if any pixel of an RGBA8 image is not fully opaque
+	bool HasAlpha(const std::vector<unsigned char>& pixels)
+	{
+		for (size_t i = 3; i < pixels.size(); i += 4)
+		{
+			if (pixels[i] != 255)
+				return true;
+		}
+		return false;
+	}
+
+	// The 1x1 layout of every slot until its image arrives
+	TextureLayout PlaceholderLayout()
+	{
+		TextureLayout layout;
+		layout.format = UNCOMPRESSED_FORMAT;
+		return layout;
+	}
+
+	inline bool IsPlaceholder(const TextureLayout& layout)
+	{
+		return layout.format == UNCOMPRESSED_FORMAT && layout.width == 1 && layout.height == 1;
+	}
+
+	inline bool operator==(const TextureLayout& a, const TextureLayout& b)
+	{
+		return a.format == b.format && a.width == b.width && a.height == b.height && a.levels == b.levels;
+	}
+
+	inline int LevelSize(int size, GLint level)
+	{
+		return size >> level > 0 ? size >> level : 1;
+	}
+
+	// Levels of a full mip chain down to 1x1
+	GLint ChainLevels(int width, int height)
+	{
+		GLint levels = 1;
+		for (int size = std::max(width, height); size > 1; size /= 2)
+			levels++;
+		return levels;
+	}
+
+	// Finest level of the tail every image first goes up with
+	GLint TailLevel(const TextureLayout& layout)
+	{
+		GLint level = 0;
+		while (LevelSize(layout.width, level) > STREAM_TAIL_SIZE || LevelSize(layout.height, level) > STREAM_TAIL_SIZE)
+			level++;
+		return level;
+	}
+
+	inline size_t LevelBytes(const TextureLayout& layout, GLint level)
+	{
+		const int width = LevelSize(layout.width, level);
+		const int height = LevelSize(layout.height, level);
+		if (layout.format == COMPRESSED_OPAQUE_FORMAT)
+			return UBlockCompressedSize(width, height, BC1_BLOCK_BYTES);
+		if (layout.format == COMPRESSED_ALPHA_FORMAT)
+			return UBlockCompressedSize(width, height, BC3_BLOCK_BYTES);
+		return size_t(width) * height * 4;
+	}
+
+	// Where a level starts in a chain laid out largest level first, whether
+	// RGBA8 from UBuildMipChain or BC1/BC3 from the cache
+	size_t ChainOffset(const TextureLayout& layout, GLint level)
+	{
+		size_t offset = 0;
+		for (GLint finer = 0; finer < level; finer++)
+			offset += LevelBytes(layout, finer);
+		return offset;
+	}
+
+	// Storage of levels first and coarser
+	GLuint64 ChainBytes(const TextureLayout& layout, GLint first)
+	{
+		return ChainOffset(layout, layout.levels) - ChainOffset(layout, first);
+	}
+
+	void SetTextureParameters(GLenum target)
+	{
+		// set the texture wrapping parameters
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		// set texture filtering parameters; streaming decides which levels hold the image
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// A cached file must hold a full chain of layer sized levels; one from
+	// another tool may not
+	bool FitsLayer(const CompressedTexture& texture)
+	{
+		if (texture.levels.empty())
+			return false;
+		const int width = texture.levels[0].width;
+		const int height = texture.levels[0].height;
+		return width == LayerSize(width) && height == LayerSize(height) &&
+			texture.levels.size() == size_t(ChainLevels(width, height));
+	}
+}
+
+TextureLoader::TextureLoader()
+	: decoded(DECODED_QUEUE_CAPACITY)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	// GL objects must be released by DestroyTextures while the context exists
+	stopping = true;
+	workers.Stop();
+}
+
+///////////////////////////////////////////////////
+//	Start(GLuint, bool, unsigned)
+//
+//	materialCount: most materials, and images, loaded
+//	at once
+//	bindless: one texture and handle per image
+//	instead of one array layer per image
+//	workerCount: decode threads
+//
+//	Every slot starts out as the placeholder: on the
+//	bindless path a 1x1 texture of its own, reallocated
+//	as levels stream in and out; on the array path
+//	layer 0 of array 0, shared until the image arrives
+//	and takes a layer of the array for its layout.
+///////////////////////////////////////////////////
+void TextureLoader::Start(GLuint materialCount, bool bindless, unsigned workerCount)
+{
+	compress = GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+	if (!compress)
+		std::cout << "sRGB S3TC not supported; textures will be uploaded uncompressed" << std::endl;
+
+	this->bindless = bindless;
+	this->materialCount = materialCount > 0 ? materialCount : 1;
+	frame = 1;
+	pathHits = 0;
+	contentHits = 0;
+
+	materials.clear();
+	materials.resize(this->materialCount);
+	slots.clear();
+	slots.resize(this->materialCount);
+	for (Slot& slot : slots)
+		slot.layout = PlaceholderLayout();
+
+	// Handed out lowest first
+	freeMaterials.clear();
+	freeSlots.clear();
+	for (GLuint index = this->materialCount; index > 0; index--)
+	{
+		freeMaterials.push_back(index - 1);
+		freeSlots.push_back(index - 1);
+	}
+
+	if (bindless)
+		CreateBindlessTextures();
+	else
+	{
+		arrays.clear();
+		const GLuint placeholder = ArrayFor(PlaceholderLayout());
+		const GLuint layer = AllocateLayer(placeholder);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[placeholder].texture);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(layer), 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_TEXEL);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+
+	// Filled in by BindTextures once materials are handed out
+	glGenBuffers(1, &materialBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint64) * this->materialCount, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	materialsChanged = true;
+
+	stopping = false;
+	workers.Start(workerCount);
+}
+
+///////////////////////////////////////////////////
+//	CreateBindlessTextures()
+//
+//	One immutable 1x1 placeholder texture per slot.
+//	Sampler state is fixed once a handle exists, so
+//	handles are taken last. They start non-resident;
+//	BindTextures makes the ones in use resident.
+///////////////////////////////////////////////////
+void TextureLoader::CreateBindlessTextures()
+{
+	const TextureLayout placeholder = PlaceholderLayout();
+
+	textures.resize(materialCount);
+	glGenTextures(GLsizei(materialCount), textures.data());
+
+	for (GLuint slot = 0; slot < materialCount; slot++)
+	{
+		glBindTexture(GL_TEXTURE_2D, textures[slot]);
+		SetTextureParameters(GL_TEXTURE_2D);
+		glTexStorage2D(GL_TEXTURE_2D, 1, placeholder.format, 1, 1);
+		glClearTexImage(textures[slot], 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_TEXEL);
+	}
+
+	const GLuint64 bytes = ChainBytes(placeholder, 0);
+	handles.resize(materialCount);
+	for (GLuint slot = 0; slot < materialCount; slot++)
+	{
+		handles[slot] = glGetTextureHandleARB(textures[slot]);
+		residency.Add(handles[slot], bytes);
+		streamedBytes += bytes;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+///////////////////////////////////////////////////
+//	ResizeBindlessTexture(GLuint, GLint)
+//
+//	slot: bindless texture to reallocate
+//	baseLevel: finest level of the slot's layout the
+//	new texture holds
+//
+//	Replace the slot's texture with one holding
+//	baseLevel and coarser, copying over the levels
+//	both have on the GPU, and point the residency
+//	manager and the material table at the new handle.
+//	Frames already submitted may still sample the
+//	old texture, so it is retired rather than deleted.
+//	Finer levels are left for the caller to upload;
+//	the new texture is left bound.
+///////////////////////////////////////////////////
+void TextureLoader::ResizeBindlessTexture(GLuint slot, GLint baseLevel)
+{
+	Slot& entry = slots[slot];
+	const TextureLayout& layout = entry.layout;
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	SetTextureParameters(GL_TEXTURE_2D);
+	glTexStorage2D(GL_TEXTURE_2D, layout.levels - baseLevel, layout.format,
+		LevelSize(layout.width, baseLevel), LevelSize(layout.height, baseLevel));
+
+	for (GLint level = std::max(baseLevel, entry.baseLevel); level < layout.levels; level++)
+	{
+		glCopyImageSubData(textures[slot], GL_TEXTURE_2D, level - entry.baseLevel, 0, 0, 0,
+			texture, GL_TEXTURE_2D, level - baseLevel, 0, 0, 0,
+			LevelSize(layout.width, level), LevelSize(layout.height, level), 1);
+	}
+
+	const GLuint64 oldHandle = handles[slot];
+	handles[slot] = glGetTextureHandleARB(texture);
+	const GLuint64 bytes = ChainBytes(layout, baseLevel);
+	const bool resident = residency.Replace(slot, handles[slot], bytes);
+	streamedBytes = streamedBytes - ChainBytes(layout, entry.baseLevel) + bytes;
+
+	retired.push_back({ textures[slot], oldHandle, resident, nullptr });
+	textures[slot] = texture;
+	entry.baseLevel = baseLevel;
+	materialsChanged = true;
+}
+
+///////////////////////////////////////////////////
+//	ReleaseRetiredTextures(bool)
+//
+//	wait: block until every fenced texture can go,
+//	as when shutting down
+//
+//	Make non-resident and delete the retired textures
+//	whose fence has signalled, oldest first. Unfenced
+//	ones may still be drawn with and are kept.
+///////////////////////////////////////////////////
+void TextureLoader::ReleaseRetiredTextures(bool wait)
+{
+	while (!retired.empty() && retired.front().fence != nullptr)
+	{
+		RetiredTexture& front = retired.front();
+		const GLenum status = glClientWaitSync(front.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+			wait ? GL_TIMEOUT_IGNORED : 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		glDeleteSync(front.fence);
+		if (front.resident)
+			glMakeTextureHandleNonResidentARB(front.handle);
+		glDeleteTextures(1, &front.texture);
+		retired.pop_front();
+	}
+}
+
+///////////////////////////////////////////////////
+//	SetSlotLayout(GLuint, const TextureLayout&)
+//
+//	slot: slot whose image is about to change
+//	layout: storage of the new image
+//
+//	Leave the slot with none of the new image's
+//	levels uploaded. On the array path the slot gives
+//	up its layer and takes one of the array for the
+//	new layout; a bindless texture keeps its old
+//	contents until the next resize replaces it.
+///////////////////////////////////////////////////
+void TextureLoader::SetSlotLayout(GLuint slot, const TextureLayout& layout)
+{
+	Slot& entry = slots[slot];
+	if (bindless)
+		streamedBytes -= ChainBytes(entry.layout, entry.baseLevel);
+	else
+	{
+		if (entry.array != 0)
+			arrays[entry.array].freeLayers.push_back(entry.layer);
+		entry.array = ArrayFor(layout);
+		entry.layer = AllocateLayer(entry.array);
+	}
+
+	entry.layout = layout;
+	entry.baseLevel = layout.levels;
+	materialsChanged = true;
+}
+
+///////////////////////////////////////////////////
+//	ArrayFor(const TextureLayout&)
+//
+//	Index of the array holding layers of layout,
+//	added without storage if there is none yet
+///////////////////////////////////////////////////
+GLuint TextureLoader::ArrayFor(const TextureLayout& layout)
+{
+	for (GLuint array = 0; array < GLuint(arrays.size()); array++)
+	{
+		if (arrays[array].layout == layout)
+			return array;
+	}
+
+	arrays.emplace_back();
+	arrays.back().layout = layout;
+	return GLuint(arrays.size() - 1);
+}
+
+///////////////////////////////////////////////////
+//	AllocateLayer(GLuint)
+//
+//	A freed layer of the array if there is one,
+//	otherwise the next unused one, doubling the
+//	array's storage when it is full
+///////////////////////////////////////////////////
+GLuint TextureLoader::AllocateLayer(GLuint array)
+{
+	TextureArray& entry = arrays[array];
+	if (!entry.freeLayers.empty())
+	{
+		const GLuint layer = entry.freeLayers.back();
+		entry.freeLayers.pop_back();
+		return layer;
+	}
+
+	if (entry.usedLayers == entry.layers)
+		GrowArray(array, std::max(entry.layers * 2, 1));
+	return GLuint(arrays[array].usedLayers++);
+}
+
+///////////////////////////////////////////////////
+//	GrowArray(GLuint, GLsizei)
+//
+//	array: array to reallocate
+//	layers: its new layer count
+//
+//	Immutable storage cannot grow, so the array is
+//	replaced with a larger one and every layer copied
+//	over on the GPU. Draws already issued keep the old
+//	texture alive until they are done with it.
+///////////////////////////////////////////////////
+void TextureLoader::GrowArray(GLuint array, GLsizei layers)
+{
+	TextureArray& entry = arrays[array];
+	const TextureLayout& layout = entry.layout;
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	SetTextureParameters(GL_TEXTURE_2D_ARRAY);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, layout.levels, layout.format, layout.width, layout.height, layers);
+
+	if (entry.texture != 0)
+	{
+		for (GLint level = 0; level < layout.levels; level++)
+		{
+			glCopyImageSubData(entry.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+				texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+				LevelSize(layout.width, level), LevelSize(layout.height, level), entry.layers);
+		}
+		glDeleteTextures(1, &entry.texture);
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	entry.texture = texture;
+	entry.layers = layers;
+}
+
+///////////////////////////////////////////////////
+//	ClearSlot(GLuint)
+//
+//	Put a freed slot back to how Start left it,
+//	showing the placeholder. A bindless texture gives
+//	its levels back; an array layer goes back to its
+//	array for the next image of that layout.
+///////////////////////////////////////////////////
+void TextureLoader::ClearSlot(GLuint slot)
+{
+	Slot& entry = slots[slot];
+	if (IsPlaceholder(entry.layout))
+		return;
+
+	if (bindless)
+	{
+		SetSlotLayout(slot, PlaceholderLayout());
+		ResizeBindlessTexture(slot, 0);
+		UploadLevel(slot, 0, PLACEHOLDER_TEXEL, GLsizei(sizeof(PLACEHOLDER_TEXEL)));
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	else
+	{
+		arrays[entry.array].freeLayers.push_back(entry.layer);
+		entry.array = 0;
+		entry.layer = 0;
+		entry.layout = PlaceholderLayout();
+		entry.baseLevel = 0;
+	}
+	materialsChanged = true;
+}
+
+///////////////////////////////////////////////////
+//	UploadLevel(GLuint, GLint, const void*, GLsizei)
+//
+//	slot: layer or texture to write
+//	level: mip level of the slot's layout, always
+//	written whole
+//	data: pointer, or offset into the bound unpack buffer
+//	bytes: compressed size of the level
+//
+//	Expects the slot's array, or its texture on the
+//	bindless path, to be bound already
+///////////////////////////////////////////////////
+void TextureLoader::UploadLevel(GLuint slot, GLint level, const void* data, GLsizei bytes)
+{
+	const Slot& entry = slots[slot];
+	const TextureLayout& layout = entry.layout;
+	const int width = LevelSize(layout.width, level);
+	const int height = LevelSize(layout.height, level);
+	const bool compressed = layout.format != UNCOMPRESSED_FORMAT;
+	if (bindless)
+	{
+		// The texture's own level 0 is the slot's base level
+		const GLint textureLevel = level - entry.baseLevel;
+		if (compressed)
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, textureLevel, 0, 0, width, height, layout.format, bytes, data);
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, textureLevel, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+	else
+	{
+		if (compressed)
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(entry.layer), width, height, 1,
+				layout.format, bytes, data);
+		else
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(entry.layer), width, height, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Load(const char*)
+//
+//	path: image file readable by stb_image
+//
+//	Look the path up in the registry, or hand out the
+//	next material and slot and submit the decode to
+//	the worker threads. Identical contents under
+//	another path are only found once decoded; Update
+//	merges those.
+///////////////////////////////////////////////////
+GLuint TextureLoader::Load(const char* path)
+{
+	std::string key = path;
+	std::replace(key.begin(), key.end(), '\\', '/');
+
+	const auto found = materialsByPath.find(key);
+	if (found != materialsByPath.end())
+	{
+		materials[found->second].references++;
+		pathHits++;
+		return found->second;
+	}
+
+	// Every live material holds at most one slot, so a free material means a free slot
+	if (freeMaterials.empty())
+	{
+		std::cout << "ERROR::TEXTURE::NO_FREE_MATERIAL: " << path << std::endl;
+		return 0;
+	}
+
+	const GLuint material = freeMaterials.back();
+	freeMaterials.pop_back();
+	const GLuint slot = freeSlots.back();
+	freeSlots.pop_back();
+
+	materials[material].path = key;
+	materials[material].slot = slot;
+	materials[material].references = 1;
+	materialsByPath[key] = material;
+	slots[slot].users = 1;
+	materialsChanged = true;
+	nPending++;
+
+	const GLuint generation = slots[slot].generation;
+	workers.Submit([this, slot, generation, key] { Decode(slot, generation, key); });
+
+	return material;
+}
+
+///////////////////////////////////////////////////
+//	Release(GLuint)
+//
+//	material: index from Load
+///////////////////////////////////////////////////
+void TextureLoader::Release(GLuint material)
+{
+	if (material >= materials.size() || materials[material].references == 0)
+		return;
+
+	Material& entry = materials[material];
+	if (--entry.references > 0)
+		return;
+
+	materialsByPath.erase(entry.path);
+	entry.path.clear();
+	freeMaterials.push_back(material);
+
+	if (--slots[entry.slot].users == 0)
+		FreeSlot(entry.slot);
+}
+
+///////////////////////////////////////////////////
+//	FreeSlot(GLuint)
+//
+//	Forget the slot's image, returning its memory on
+//	the bindless path, and make it available to Load.
+//	A decode still in flight for it is dropped when
+//	it arrives.
+///////////////////////////////////////////////////
+void TextureLoader::FreeSlot(GLuint slot)
+{
+	Slot& entry = slots[slot];
+
+	const auto found = slotsByHash.find(entry.hash);
+	if (found != slotsByHash.end() && found->second == slot)
+		slotsByHash.erase(found);
+
+	entry.source.reset();
+	entry.hash = 0;
+	entry.users = 0;
+	entry.generation++;
+	ClearSlot(slot);
+	freeSlots.push_back(slot);
+}
+
+///////////////////////////////////////////////////
+//	MergeSlot(GLuint, GLuint)
+//
+//	from: slot whose image turned out identical to
+//	to's
+//
+//	Point every material using from at to and free from
+///////////////////////////////////////////////////
+void TextureLoader::MergeSlot(GLuint from, GLuint to)
+{
+	for (Material& material : materials)
+	{
+		if (material.references > 0 && material.slot == from)
+			material.slot = to;
+	}
+	slots[to].users += slots[from].users;
+	FreeSlot(from);
+	materialsChanged = true;
+}
+
+///////////////////////////////////////////////////
+//	Decode(GLuint, GLuint, const std::string&)
+//
+//	slot: where the result is uploaded
+//	generation: the slot's generation when submitted
+//	path: source image; the result is handed to the GL
+//	thread through the decoded queue
+//
+//	The source bytes are hashed for the registry.
+//	With compression on, a cached mip chain is mapped
+//	if there is one for that hash; otherwise the
+//	image is decoded, resized, cooked (BC1 if every
+//	pixel is opaque, else BC3) and written to the
+//	cache for the next run.
+//
+//	Runs on a worker thread; never touches GL
+///////////////////////////////////////////////////
+void TextureLoader::Decode(GLuint slot, GLuint generation, const std::string& path)
+{
+	if (stopping)
+		return;
+
+	DecodedImage* image = new DecodedImage();
+	image->slot = slot;
+	image->generation = generation;
+	image->hash = 0;
+	image->path = path;
+
+	MappedFile source;
+	if (source.Open(path.c_str()))
+	{
+		image->hash = UHashTextureSource(source.Data(), source.Size());
+
+		std::string cachePath;
+		std::unique_ptr<CompressedTexture> compressed;
+		if (compress)
+		{
+			cachePath = UTextureCachePath(image->hash);
+			compressed.reset(new CompressedTexture());
+			if (ULoadTextureCache(cachePath.c_str(), *compressed) && FitsLayer(*compressed))
+				image->compressed = std::move(compressed);
+		}
+
+		std::vector<unsigned char> pixels, chain;
+		if (image->compressed)
+		{
+			image->width = image->compressed->levels[0].width;
+			image->height = image->compressed->levels[0].height;
+		}
+		else if (LoadLayerPixels(source, &workers, pixels, image->width, image->height))
+		{
+			// Resizing and levels are split across the pool, with this worker taking bands as well
+			UBuildMipChain(pixels.data(), image->width, image->height, TEXTURE_MIP_FILTER, &workers, chain);
+
+			if (!compress)
+				image->pixels.swap(chain);
+			else if (UCookTexture(chain.data(), image->width, image->height, HasAlpha(pixels), *compressed))
+			{
+				UWriteTextureCache(cachePath.c_str(), *compressed);
+				image->compressed = std::move(compressed);
+			}
+		}
+	}
+
+	while (!decoded.TryPush(image))
+	{
+		if (stopping)
+		{
+			delete image;
+			return;
+		}
+		std::this_thread::yield();
+	}
+}
+
+///////////////////////////////////////////////////
+//	Update()
+//
+//	Drain the decoded queue without blocking. An image
+//	identical to one already uploaded is merged into
+//	it; any other takes storage for its format, has
+//	the tail of its chain uploaded and is kept for
+//	Stream. Then stream levels in and
+//	out for what was drawn since the last call.
+///////////////////////////////////////////////////
+GLuint TextureLoader::Update()
+{
+	GLuint uploaded = 0;
+
+	DecodedImage* image;
+	while (decoded.TryPop(image))
+	{
+		nPending--;
+		Slot& slot = slots[image->slot];
+		if (image->generation != slot.generation)
+		{
+			delete image;   // released while it was decoding
+			continue;
+		}
+		if (!image->compressed && image->pixels.empty())
+		{
+			std::cout << "Failed to load texture " << image->path << std::endl;
+			delete image;
+			continue;
+		}
+
+		const auto found = slotsByHash.find(image->hash);
+		if (found != slotsByHash.end())
+		{
+			MergeSlot(image->slot, found->second);
+			contentHits++;
+			delete image;
+			continue;
+		}
+
+		TextureLayout layout;
+		layout.format = UNCOMPRESSED_FORMAT;
+		if (image->compressed)
+			layout.format = image->compressed->format == COMPRESSED_BC1 ? COMPRESSED_OPAQUE_FORMAT : COMPRESSED_ALPHA_FORMAT;
+		layout.width = image->width;
+		layout.height = image->height;
+		layout.levels = ChainLevels(image->width, image->height);
+
+		const GLuint index = image->slot;
+		slotsByHash[image->hash] = index;
+		slot.hash = image->hash;
+		slot.source.reset(image);
+		SetSlotLayout(index, layout);
+		UploadLevels(index, TailLevel(layout), layout.levels);
+		uploaded++;
+	}
+
+	Stream();
+	frame++;
+
+	return uploaded;
+}
+
+///////////////////////////////////////////////////
+//	UseMaterial(GLuint, float)
+//
+//	material: index from Load
+//	footprint: pixels one repeat of the texture spans
+//	on screen, erring large
+///////////////////////////////////////////////////
+void TextureLoader::UseMaterial(GLuint material, float footprint)
+{
+	if (material >= materials.size() || materials[material].references == 0)
+		return;
+
+	const GLuint index = materials[material].slot;
+	if (bindless)
+		residency.Use(index);
+
+	// Finest level with no more than one texel per pixel along the longer side
+	Slot& slot = slots[index];
+	const float texelsPerPixel = float(std::max(slot.layout.width, slot.layout.height)) / std::max(footprint, 1.0f);
+	const GLint level = std::min(std::max(GLint(std::floor(std::log2(texelsPerPixel))), 0), TailLevel(slot.layout));
+
+	if (slot.requestFrame != frame || level < slot.requestedLevel)
+	{
+		slot.requestedLevel = level;
+		slot.requestFrame = frame;
+	}
+}
+
+// Level a slot was asked for since the last Update; one not drawn needs only the tail
+GLint TextureLoader::WantedLevel(const Slot& slot) const
+{
+	return slot.requestFrame == frame ? slot.requestedLevel : TailLevel(slot.layout);
+}
+
+///////////////////////////////////////////////////
+//	Stream()
+//
+//	Upload the next finer level of every image drawn
+//	larger than its base level allows, those furthest
+//	from what they need first, until the per-call
+//	upload budget is spent. One level per image per
+//	call keeps the cost of a camera cut spread over a
+//	few frames.
+//
+//	Bindless textures that kept finer levels than
+//	they needed for STREAM_EVICT_FRAMES drop them one
+//	level per call; the array's storage is fixed, so
+//	its layers only ever get finer.
+///////////////////////////////////////////////////
+void TextureLoader::Stream()
+{
+	candidates.clear();
+	for (GLuint index = 0; index < materialCount; index++)
+	{
+		Slot& slot = slots[index];
+		if (!slot.source)
+			continue;   // free, not decoded yet, or complete in the array
+
+		const GLint wanted = WantedLevel(slot);
+		if (wanted <= slot.baseLevel)
+			slot.neededFrame = frame;
+
+		if (wanted < slot.baseLevel)
+			candidates.push_back(index);
+		else if (bindless && wanted > slot.baseLevel && frame - slot.neededFrame > STREAM_EVICT_FRAMES)
+		{
+			ResizeBindlessTexture(index, slot.baseLevel + 1);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [this](GLuint a, GLuint b) {
+		return slots[a].baseLevel - WantedLevel(slots[a]) > slots[b].baseLevel - WantedLevel(slots[b]);
+	});
+
+	GLsizeiptr uploaded = 0;
+	for (GLuint index : candidates)
+	{
+		const GLint level = slots[index].baseLevel - 1;
+		const GLsizeiptr bytes = GLsizeiptr(LevelBytes(slots[index].layout, level));
+		if (uploaded > 0 && uploaded + bytes > STREAM_UPLOAD_BUDGET)
+			continue;
+		if (bindless && !MakeRoom(GLuint64(bytes)))
+			continue;
+
+		UploadLevels(index, level, level + 1);
+		uploaded += bytes;
+	}
+}
+
+///////////////////////////////////////////////////
+//	MakeRoom(GLuint64)
+//
+//	bytes: storage a bindless texture is about to grow by
+//
+//	Drop levels finer than they need from the least
+//	recently needed textures until bytes more fit the
+//	budget; false if they cannot be made to fit, in
+//	which case the image stays blurrier
+///////////////////////////////////////////////////
+bool TextureLoader::MakeRoom(GLuint64 bytes)
+{
+	while (streamedBytes + bytes > residency.Budget())
+	{
+		GLuint victim = materialCount;
+		for (GLuint index = 0; index < materialCount; index++)
+		{
+			const Slot& slot = slots[index];
+			if (slot.source && WantedLevel(slot) > slot.baseLevel &&
+				(victim == materialCount || slot.neededFrame < slots[victim].neededFrame))
+				victim = index;
+		}
+		if (victim == materialCount)
+			return false;
+
+		ResizeBindlessTexture(victim, slots[victim].baseLevel + 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	UploadLevels(GLuint, GLint, GLint)
+//
+//	slot: a slot whose image has arrived
+//	first, last: levels [first, last) of its chain
+//
+//	Copy the levels into the pixel unpack buffer and
+//	source the slot from it, so the upload returns
+//	without waiting for the transfer. A bindless
+//	texture is first reallocated to hold them; an
+//	array layer's LOD clamp is lowered.
+///////////////////////////////////////////////////
+void TextureLoader::UploadLevels(GLuint slot, GLint first, GLint last)
+{
+	Slot& entry = slots[slot];
+	const DecodedImage& image = *entry.source;
+	const unsigned char* chain = image.compressed ? image.compressed->Data() : image.pixels.data();
+
+	const size_t start = ChainOffset(entry.layout, first);
+	const size_t size = ChainOffset(entry.layout, last) - start;
+	void* staging = MapPixelBuffer(GLsizeiptr(size));
+	if (staging == nullptr)
+	{
+		std::cout << "ERROR::TEXTURE::MAP_FAILED: " << image.path << std::endl;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return;
+	}
+	memcpy(staging, chain + start, size);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	const GLenum target = bindless ? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY;
+	if (bindless && first < entry.baseLevel)
+		ResizeBindlessTexture(slot, first);
+	else
+		glBindTexture(target, bindless ? textures[slot] : arrays[entry.array].texture);
+
+	for (GLint level = first; level < last; level++)
+	{
+		const size_t offset = ChainOffset(entry.layout, level) - start;
+		UploadLevel(slot, level, (void*)offset, GLsizei(LevelBytes(entry.layout, level)));
+	}
+
+	glBindTexture(target, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (!bindless)
+	{
+		entry.baseLevel = std::min(entry.baseLevel, first);
+		materialsChanged = true;
+
+		// A complete layer never changes again, so its image is no longer needed
+		if (entry.baseLevel == 0)
+			entry.source.reset();
+	}
+}
+
+TextureStats TextureLoader::Stats() const
+{
+	TextureStats stats = {};
+	stats.materials = GLuint(materialsByPath.size());
+	stats.pathHits = pathHits;
+	stats.contentHits = contentHits;
+
+	for (const Slot& slot : slots)
+	{
+		if (slot.users == 0)
+			continue;
+		stats.images++;
+		if (slot.layout.format == COMPRESSED_OPAQUE_FORMAT)
+			stats.opaqueImages++;
+		if (!IsPlaceholder(slot.layout) && slot.baseLevel < slot.layout.levels)
+			stats.streamedBytes += ChainBytes(slot.layout, slot.baseLevel);
+	}
+
+	if (bindless)
+		stats.allocatedBytes = streamedBytes;
+	for (const TextureArray& array : arrays)
+		stats.allocatedBytes += ChainBytes(array.layout, 0) * GLuint64(array.layers);
+	return stats;
+}
+
+///////////////////////////////////////////////////
+//	BindTextures()
+//
+//	The material table is rebuilt here when anything
+//	it holds has changed. Residency is settled here
+//	too, right before the draw that samples the
+//	handles, so a handle marked by UseMaterial this
+//	frame is always resident in time.
+//
+//	Every draw that may sample a texture retired since
+//	the last call was issued before the table is
+//	rewritten, so a fence here covers them all; the
+//	texture goes once it signals.
+///////////////////////////////////////////////////
+void TextureLoader::BindTextures()
+{
+	if (bindless)
+	{
+		ReleaseRetiredTextures(false);
+		for (auto texture = retired.rbegin(); texture != retired.rend() && texture->fence == nullptr; ++texture)
+			texture->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	if (materialsChanged)
+	{
+		// Free materials keep whatever they last held; nothing draws with them
+		std::vector<GLuint> table(materialCount * 2, 0);
+		for (GLuint material = 0; material < materialCount; material++)
+		{
+			const GLuint slot = materials[material].slot;
+			if (bindless)
+				memcpy(&table[material * 2], &handles[slot], sizeof(GLuint64));
+			else
+			{
+				const float minLod = float(slots[slot].baseLevel);
+				table[material * 2] = slots[slot].layer;
+				memcpy(&table[material * 2 + 1], &minLod, sizeof(float));
+			}
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * table.size(), table.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		materialsChanged = false;
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_SSBO_BINDING, materialBuffer);
+
+	if (bindless)
+		residency.Update();
+}
+
+GLuint TextureLoader::MaterialArray(GLuint material) const
+{
+	if (bindless || material >= materials.size() || materials[material].references == 0)
+		return 0;
+	return slots[materials[material].slot].array;
+}
+
+void TextureLoader::BindArray(GLuint array)
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[array].texture);
+}
+
+///////////////////////////////////////////////////
+//	MapPixelBuffer(GLsizeiptr)
+//
+//	size: bytes the next upload needs
+//
+//	Bind the staging buffer, orphan it and map it for
+//	writing; returns null (still bound) on failure
+///////////////////////////////////////////////////
+void* TextureLoader::MapPixelBuffer(GLsizeiptr size)
+{
+	if (pixelBuffer == 0)
+		glGenBuffers(1, &pixelBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+
+	// Orphan the previous contents so an upload still in flight is not stalled on
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	return glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+void TextureLoader::DestroyTextures()
+{
+	stopping = true;
+	workers.Stop();
+
+	DecodedImage* image;
+	while (decoded.TryPop(image))
+		delete image;
+	nPending = 0;
+
+	materials.clear();
+	slots.clear();
+	freeMaterials.clear();
+	freeSlots.clear();
+	materialsByPath.clear();
+	slotsByHash.clear();
+
+	// Handles must not be resident when their textures are deleted
+	for (RetiredTexture& texture : retired)
+	{
+		if (texture.fence == nullptr)
+			texture.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	ReleaseRetiredTextures(true);
+	residency.Clear();
+	if (!textures.empty())
+		glDeleteTextures(GLsizei(textures.size()), textures.data());
+	textures.clear();
+	handles.clear();
+	streamedBytes = 0;
+
+	for (const TextureArray& array : arrays)
+		glDeleteTextures(1, &array.texture);
+	arrays.clear();
+	glDeleteBuffers(1, &materialBuffer);
+	materialBuffer = 0;
+	materialCount = 0;
+
+	glDeleteBuffers(1, &pixelBuffer);
+	pixelBuffer = 0;
+}
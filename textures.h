@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////////////////////////////////
+// textures.h
+// ========
+// asynchronous texture loading into the layers of a few texture arrays, or
+// into separate textures sampled through bindless handles: images are decoded
+// on worker threads, resized to power of two sides and uploaded on the GL
+// thread through a pixel buffer object, with a placeholder shown until each
+// one arrives. Where S3TC is supported the workers block compress each image
+// once into the texture cache, as BC1 unless it has alpha, and later runs
+// upload the cached mip chain directly. Mips stream in: each image first goes
+// up with only its smallest levels, and finer ones follow as the objects
+// using it grow on screen.
+//
+// Loaded textures form a registry: materials are reference counted by path,
+// and images with identical contents share one layer or texture.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "queues.h"
+#include "residency.h"
+#include "texturecache.h"
+#include "threadpool.h"
+
+// Images are stored with a full mip chain, each side resampled to the power
+// of two nearest its size, up to this; images of one size and format share
+// an array
+const int TEXTURE_MAX_LAYER_SIZE = 1024;
+
+// Storage of one image's mip chain, which its layer or bindless texture holds
+// from some base level down
+struct TextureLayout
+{
+	GLenum format = 0;
+	int width = 1;
+	int height = 1;
+	GLint levels = 1;
+};
+
+// Shader storage binding of the material table: per material, the bindless
+// handle (uvec2), or the array layer and the finest level streamed into it
+// so far, which the shader must not sample below (uint, float)
+const GLuint MATERIAL_SSBO_BINDING = 0;
+
+struct TextureStats
+{
+	GLuint materials;           // Distinct paths loaded
+	GLuint images;              // Layers or textures in use, after deduplication
+	GLuint opaqueImages;        // Of those, compressed to BC1 since no pixel has alpha
+	GLuint pathHits;            // Loads answered by a material already loaded
+	GLuint contentHits;         // Images found identical to one already loaded
+	GLuint64 streamedBytes;     // Levels of the images in use uploaded so far
+	GLuint64 allocatedBytes;    // GPU storage of the arrays, or of every bindless texture
+};
+
+class TextureLoader
+{
+public:
+	TextureLoader();
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// Allocates materialCount placeholder textures and starts the decode
+	// threads; 0 workers picks one less than the hardware thread count. With
+	// bindless set (only if GL_ARB_bindless_texture is supported) every
+	// image is its own texture whose handle sits in the material SSBO;
+	// otherwise each is a layer of the texture array for its size and format.
+	// Needs a current context.
+	void Start(GLuint materialCount, bool bindless, unsigned workerCount = 0);
+
+	// Returns the material for path, adding a reference if it is already
+	// loaded; otherwise takes a free one at once and queues the image for
+	// decoding. The material shows the placeholder until Update uploads it.
+	// Returns 0 with an error if every material is in use.
+	GLuint Load(const char* path);
+
+	// Drops a reference from Load; the last one frees the material, and its
+	// layer or texture once no other material shares the image
+	void Release(GLuint material);
+
+	// GL thread only: uploads every image decoded since the last call and
+	// returns how many were uploaded
+	GLuint Update();
+
+	// Number of requested textures that have not been uploaded (or failed) yet
+	GLuint Pending() const { return nPending; }
+
+	TextureStats Stats() const;
+
+	// Binds what the shaders sample: the material SSBO, and on the bindless
+	// path the handles used this frame made resident
+	void BindTextures();
+
+	// Texture array holding a material's layer, which must be bound with
+	// BindArray to draw it; array 0 holds the placeholder. Changes when the
+	// material's image arrives. Always 0 on the bindless path.
+	GLuint MaterialArray(GLuint material) const;
+
+	// Array path: binds an array from MaterialArray on unit 0
+	void BindArray(GLuint array);
+
+	// Marks a material as drawn this frame, one repeat of its texture covering
+	// about footprint pixels across: keeps its handle resident and asks Update
+	// to stream in the finest level that footprint needs
+	void UseMaterial(GLuint material, float footprint);
+
+	// Memory the bindless textures may occupy; finer levels are dropped from
+	// the least recently needed images to stay within it
+	void SetResidencyBudget(GLuint64 bytes) { residency.SetBudget(bytes); }
+
+	// Stops the workers, drops anything not yet uploaded and deletes every texture
+	void DestroyTextures();
+
+private:
+	// Handed from a worker to the GL thread; pixels and compressed are both
+	// empty if decoding failed
+	struct DecodedImage
+	{
+		GLuint slot;
+		GLuint generation;                                  // Stale if the slot was freed since
+		unsigned long long hash;                            // UHashTextureSource of the file
+		std::string path;
+		int width = 0;                                      // Of the finest level
+		int height = 0;
+		std::vector<unsigned char> pixels;                  // Uncompressed fallback: RGBA8 mip chain
+		std::unique_ptr<CompressedTexture> compressed;      // Cooked or mapped from the cache
+	};
+
+	// What a material index handed out by Load refers to
+	struct Material
+	{
+		std::string path;
+		GLuint slot = 0;
+		GLuint references = 0;      // 0 when free
+	};
+
+	// One image's storage: a layer of an array, or a bindless texture. Levels
+	// baseLevel and coarser of layout are uploaded; on the bindless path the
+	// texture holds only those. Until the image arrives, and once it is freed,
+	// the layout is the 1x1 placeholder.
+	struct Slot
+	{
+		std::unique_ptr<DecodedImage> source;   // Kept so finer levels can go up later
+		TextureLayout layout;
+		GLint baseLevel = 0;
+		GLuint array = 0;           // Array path: arrays index and layer within it
+		GLuint layer = 0;
+		GLint requestedLevel = 0;   // Finest level UseMaterial asked for in requestFrame
+		GLuint64 requestFrame = 0;
+		GLuint64 neededFrame = 0;   // Last frame baseLevel was fine enough and no finer
+		GLuint users = 0;           // Materials sharing the image; 0 when free
+		GLuint generation = 0;      // Bumped when freed, so decodes in flight are dropped
+		unsigned long long hash = 0;
+	};
+
+	// Bindless path: a texture replaced by a resize, kept until every draw
+	// that may sample it has finished
+	struct RetiredTexture
+	{
+		GLuint texture;
+		GLuint64 handle;
+		bool resident;              // Handle still resident from before the resize
+		GLsync fence;               // Null until BindTextures fences the draws before it
+	};
+
+	// Array path: layers of one layout, added as images arrive
+	struct TextureArray
+	{
+		GLuint texture = 0;
+		TextureLayout layout;
+		GLsizei layers = 0;         // Allocated
+		GLsizei usedLayers = 0;     // Ever handed out; freed ones go to freeLayers
+		std::vector<GLuint> freeLayers;
+	};
+
+	void Decode(GLuint slot, GLuint generation, const std::string& path);
+	void Stream();
+	GLint WantedLevel(const Slot& slot) const;
+	bool MakeRoom(GLuint64 bytes);
+	void MergeSlot(GLuint from, GLuint to);
+	void FreeSlot(GLuint slot);
+	void UploadLevels(GLuint slot, GLint first, GLint last);
+	void UploadLevel(GLuint slot, GLint level, const void* data, GLsizei bytes);
+	void CreateBindlessTextures();
+	void ResizeBindlessTexture(GLuint slot, GLint baseLevel);
+	void SetSlotLayout(GLuint slot, const TextureLayout& layout);
+	GLuint ArrayFor(const TextureLayout& layout);
+	GLuint AllocateLayer(GLuint array);
+	void GrowArray(GLuint array, GLsizei layers);
+	void ClearSlot(GLuint slot);
+	void ReleaseRetiredTextures(bool wait);
+	void* MapPixelBuffer(GLsizeiptr size);
+
+	ThreadPool workers;
+	BoundedQueue<DecodedImage*> decoded;
+	std::atomic<bool> stopping{ false };
+	bool compress = false;          // Set by Start from the S3TC extension
+	bool bindless = false;
+
+	std::vector<TextureArray> arrays;   // Array path: one per layout in use
+	std::vector<GLuint> textures;   // Bindless path: one texture per slot
+	std::vector<GLuint64> handles;  // Bindless path: handle of each texture
+	ResidencyManager residency;     // Bindless path: indexed by slot
+	std::deque<RetiredTexture> retired; // Bindless path: oldest first
+	GLuint64 streamedBytes = 0;     // Bindless path: storage of every texture
+
+	GLuint materialCount = 0;       // Capacity of both materials and slots
+	std::vector<Material> materials;
+	std::vector<Slot> slots;
+	std::vector<GLuint> freeMaterials;
+	std::vector<GLuint> freeSlots;
+	std::unordered_map<std::string, GLuint> materialsByPath;
+	std::unordered_map<unsigned long long, GLuint> slotsByHash;    // Uploaded images only
+	GLuint pathHits = 0;
+	GLuint contentHits = 0;
+
+	GLuint materialBuffer = 0;      // Material table, rebuilt when materialsChanged
+	bool materialsChanged = false;
+	GLuint pixelBuffer = 0;         // Staging buffer reused by every upload
+	GLuint nPending = 0;
+	std::vector<GLuint> candidates; // Scratch for Stream, kept to avoid reallocating
+	GLuint64 frame = 1;
+};
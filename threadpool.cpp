@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+// threadpool.cpp
+// ========
+// fixed set of worker threads that run queued jobs in submission order
+///////////////////////////////////////////////////////////////////////////////
+
+#include "threadpool.h"
+
+#include <memory>
+
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
+
+///////////////////////////////////////////////////
+//	Start(unsigned)
+//
+//	workerCount: number of threads to create, or 0 to
+//	leave one hardware thread for the render loop
+///////////////////////////////////////////////////
+void ThreadPool::Start(unsigned workerCount)
+{
+	Stop();
+
+	if (workerCount == 0)
+	{
+		const unsigned hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	stopping = false;
+	for (unsigned i = 0; i < workerCount; i++)
+		workers.emplace_back(&ThreadPool::WorkerMain, this);
+}
+
+void ThreadPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		jobs.clear();
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void ThreadPool::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+///////////////////////////////////////////////////
+//	ParallelFor(unsigned, const std::function<void(unsigned)>&)
+//
+//	count: number of indices
+//	body: called once per index, from any thread
+//
+//	Indices are claimed from a shared counter. Helper
+//	jobs queue behind whatever is already submitted;
+//	if they start late they find nothing left and
+//	return, so the caller never waits on a queue.
+///////////////////////////////////////////////////
+void ThreadPool::ParallelFor(unsigned count, const std::function<void(unsigned)>& body)
+{
+	struct Batch
+	{
+		std::function<void(unsigned)> body;
+		unsigned count;
+		std::atomic<unsigned> next{ 0 };
+		std::atomic<unsigned> done{ 0 };
+
+		void Run()
+		{
+			for (unsigned i = next++; i < count; i = next++)
+			{
+				body(i);
+				done++;
+			}
+		}
+	};
+
+	if (count == 0)
+		return;
+
+	// Helpers may outlive this call, so the batch is shared; body is only
+	// ever called while the caller is still waiting below
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->body = body;
+	batch->count = count;
+
+	const unsigned helpers = count - 1 < WorkerCount() ? count - 1 : WorkerCount();
+	for (unsigned i = 0; i < helpers; i++)
+		Submit([batch] { batch->Run(); });
+
+	batch->Run();
+	while (batch->done < count)
+		std::this_thread::yield();
+}
+
+void ThreadPool::WorkerMain()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
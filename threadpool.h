@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////////////////
+// threadpool.h
+// ========
+// fixed set of worker threads that run queued jobs in submission order
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	ThreadPool() = default;
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Starts workerCount threads; 0 picks one less than the hardware thread count
+	void Start(unsigned workerCount = 0);
+
+	// Lets running jobs finish, drops the ones still queued and joins every worker
+	void Stop();
+
+	void Submit(std::function<void()> job);
+
+	// Runs body(0) .. body(count - 1) across the workers and the calling thread
+	// and returns once all have finished. The caller takes indices as well, so
+	// this is safe to call from a job running on this pool.
+	void ParallelFor(unsigned count, const std::function<void(unsigned)>& body);
+
+	unsigned WorkerCount() const { return unsigned(workers.size()); }
+
+private:
+	void WorkerMain();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+};
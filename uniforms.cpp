@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// uniforms.cpp
+// ========
+// reflect the active uniforms of a linked shader program once and hand out
+// typed handles, so the per-frame path never looks a uniform up by name
+///////////////////////////////////////////////////////////////////////////////
+
+#include "uniforms.h"
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+	// Process wide name pool; only touched while programs are being linked
+	std::unordered_map<std::string, UniformName> gNameIds;
+	std::vector<std::string> gNames;
+
+	// Spreads sequential name ids across the table (Fibonacci hashing)
+	inline GLuint HashName(UniformName name)
+	{
+		return name * 2654435769u;
+	}
+}
+
+///////////////////////////////////////////////////
+//	UInternUniformName(const char*)
+//
+//	name: uniform name as written in GLSL
+//
+//	Map a uniform name to a small integer id that is
+//	stable for the lifetime of the process
+///////////////////////////////////////////////////
+UniformName UInternUniformName(const char* name)
+{
+	auto found = gNameIds.find(name);
+	if (found != gNameIds.end())
+		return found->second;
+
+	UniformName id = static_cast<UniformName>(gNames.size());
+	gNames.push_back(name);
+	gNameIds.emplace(gNames.back(), id);
+	return id;
+}
+
+bool UIsIntegerUniformType(GLenum type)
+{
+	switch (type)
+	{
+	case GL_INT:
+	case GL_BOOL:
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_1D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY_SHADOW:
+	case GL_SAMPLER_CUBE_SHADOW:
+	case GL_SAMPLER_2D_MULTISAMPLE:
+	case GL_SAMPLER_BUFFER:
+	case GL_INT_SAMPLER_2D:
+	case GL_UNSIGNED_INT_SAMPLER_2D:
+		return true;
+	default:
+		return false;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Reflect(GLuint)
+//
+//	programId: a successfully linked shader program
+//
+//	Enumerate every active uniform once and store its
+//	location and type keyed by interned name. Uniforms
+//	that live in a uniform block have no location and
+//	are skipped.
+///////////////////////////////////////////////////
+void UniformTable::Reflect(GLuint programId)
+{
+	this->programId = programId;
+	nUniforms = 0;
+
+	GLint activeUniforms = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &activeUniforms);
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	// Keep the load factor at or below one half
+	GLuint capacity = 8;
+	while (capacity < GLuint(activeUniforms) * 2)
+		capacity *= 2;
+	slots.assign(capacity, Slot{ INVALID_UNIFORM_NAME, -1, GL_NONE, 0 });
+
+	std::vector<char> nameBuffer(maxNameLength > 0 ? maxNameLength : 1);
+	for (GLint i = 0; i < activeUniforms; i++)
+	{
+		GLsizei nameLength = 0;
+		GLint size = 0;
+		GLenum type = GL_NONE;
+		glGetActiveUniform(programId, GLuint(i), GLsizei(nameBuffer.size()), &nameLength, &size, &type, nameBuffer.data());
+
+		GLint location = glGetUniformLocation(programId, nameBuffer.data());
+		if (location < 0)
+			continue;
+
+		// Arrays are reported as "name[0]"; register them under the bare name
+		std::string name(nameBuffer.data(), nameLength);
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			name.resize(name.size() - 3);
+
+		Insert(Slot{ UInternUniformName(name.c_str()), location, type, size });
+	}
+}
+
+GLint UniformTable::Location(UniformName name) const
+{
+	const Slot* slot = Find(name);
+	return slot != nullptr ? slot->location : -1;
+}
+
+const UniformTable::Slot* UniformTable::Find(UniformName name) const
+{
+	if (slots.empty() || name == INVALID_UNIFORM_NAME)
+		return nullptr;
+
+	const GLuint mask = GLuint(slots.size()) - 1;
+	for (GLuint i = HashName(name) & mask; ; i = (i + 1) & mask)
+	{
+		if (slots[i].name == name)
+			return &slots[i];
+		if (slots[i].name == INVALID_UNIFORM_NAME)
+			return nullptr;
+	}
+}
+
+void UniformTable::Insert(const Slot& slot)
+{
+	const GLuint mask = GLuint(slots.size()) - 1;
+	GLuint i = HashName(slot.name) & mask;
+	while (slots[i].name != INVALID_UNIFORM_NAME && slots[i].name != slot.name)
+		i = (i + 1) & mask;
+
+	if (slots[i].name == INVALID_UNIFORM_NAME)
+		nUniforms++;
+	slots[i] = slot;
+}
+
+void UniformTable::ReportTypeMismatch(UniformName name, GLenum type) const
+{
+	std::cout << "WARNING::UNIFORM::TYPE_MISMATCH: " << gNames[name]
+		<< " in program " << programId << " has GL type 0x" << std::hex << type << std::dec << std::endl;
+}
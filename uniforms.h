@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////////
+// uniforms.h
+// ========
+// reflect the active uniforms of a linked shader program once and hand out
+// typed handles, so the per-frame path never looks a uniform up by name
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <vector>
+
+// Interned uniform name: an index into the process wide name pool
+typedef GLuint UniformName;
+const UniformName INVALID_UNIFORM_NAME = 0xFFFFFFFFu;
+
+// Returns the interned id for a uniform name, adding it to the pool if needed
+UniformName UInternUniformName(const char* name);
+
+// Returns true if a reflected GL type can be written through a handle of type T
+template <typename T> bool UUniformAccepts(GLenum type);
+
+// Typed handle to one uniform of one program. Writes go through
+// glProgramUniform* so the program does not need to be bound.
+template <typename T>
+struct Uniform
+{
+	GLuint program = 0;     // Program the location belongs to
+	GLint location = -1;    // -1 when the uniform is inactive (GL ignores writes to -1)
+
+	bool IsValid() const { return location >= 0; }
+	void Set(const T& value) const;
+};
+
+template <> inline void Uniform<GLint>::Set(const GLint& value) const
+{
+	glProgramUniform1i(program, location, value);
+}
+
+template <> inline void Uniform<GLfloat>::Set(const GLfloat& value) const
+{
+	glProgramUniform1f(program, location, value);
+}
+
+template <> inline void Uniform<glm::vec2>::Set(const glm::vec2& value) const
+{
+	glProgramUniform2fv(program, location, 1, glm::value_ptr(value));
+}
+
+template <> inline void Uniform<glm::vec3>::Set(const glm::vec3& value) const
+{
+	glProgramUniform3fv(program, location, 1, glm::value_ptr(value));
+}
+
+template <> inline void Uniform<glm::vec4>::Set(const glm::vec4& value) const
+{
+	glProgramUniform4fv(program, location, 1, glm::value_ptr(value));
+}
+
+template <> inline void Uniform<glm::mat3>::Set(const glm::mat3& value) const
+{
+	glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+template <> inline void Uniform<glm::mat4>::Set(const glm::mat4& value) const
+{
+	glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+class UniformTable
+{
+	// One reflected uniform, stored in an open addressed table keyed by name
+	struct Slot
+	{
+		UniformName name;   // INVALID_UNIFORM_NAME marks an empty slot
+		GLint location;
+		GLenum type;
+		GLint size;         // Array length (1 for non-arrays)
+	};
+
+public:
+	// Enumerates GL_ACTIVE_UNIFORMS of a linked program and rebuilds the table
+	void Reflect(GLuint programId);
+
+	// Resolves a typed handle; returns an invalid handle if the uniform is
+	// inactive or its GL type does not match T
+	template <typename T>
+	Uniform<T> Get(const char* name) const
+	{
+		return Get<T>(UInternUniformName(name));
+	}
+
+	template <typename T>
+	Uniform<T> Get(UniformName name) const
+	{
+		Uniform<T> handle;
+		handle.program = programId;
+
+		const Slot* slot = Find(name);
+		if (slot == nullptr)
+			return handle;
+
+		if (!UUniformAccepts<T>(slot->type))
+		{
+			ReportTypeMismatch(name, slot->type);
+			return handle;
+		}
+
+		handle.location = slot->location;
+		return handle;
+	}
+
+	// Raw location lookup for callers that only have a name at hand
+	GLint Location(UniformName name) const;
+
+	GLuint ProgramId() const { return programId; }
+	GLuint Count() const { return nUniforms; }
+
+private:
+	const Slot* Find(UniformName name) const;
+	void Insert(const Slot& slot);
+	void ReportTypeMismatch(UniformName name, GLenum type) const;
+
+	GLuint programId = 0;
+	GLuint nUniforms = 0;
+	std::vector<Slot> slots;    // Power of two sized, linear probing
+};
+
+template <> inline bool UUniformAccepts<GLfloat>(GLenum type) { return type == GL_FLOAT; }
+template <> inline bool UUniformAccepts<glm::vec2>(GLenum type) { return type == GL_FLOAT_VEC2; }
+template <> inline bool UUniformAccepts<glm::vec3>(GLenum type) { return type == GL_FLOAT_VEC3; }
+template <> inline bool UUniformAccepts<glm::vec4>(GLenum type) { return type == GL_FLOAT_VEC4; }
+template <> inline bool UUniformAccepts<glm::mat3>(GLenum type) { return type == GL_FLOAT_MAT3; }
+template <> inline bool UUniformAccepts<glm::mat4>(GLenum type) { return type == GL_FLOAT_MAT4; }
+
+// ints, bools and every sampler type are written with glProgramUniform1i
+bool UIsIntegerUniformType(GLenum type);
+template <> inline bool UUniformAccepts<GLint>(GLenum type) { return UIsIntegerUniformType(type); }